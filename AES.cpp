@@ -1,4 +1,6 @@
 #include "AES.h"
+#include "AESNI.h"
+#include "AESBitslice.h"
 
 AES::AES(int keyLen)
 {
@@ -24,497 +26,534 @@ AES::AES(int keyLen)
   blockBytesLen = 4 * this->Nb * sizeof(unsigned char);
 }
 
-void AES::EncryptECB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned int outLen)
+/*
+ * Round tables, built on first use.  Te[n] and Td[n] are the same table rotated
+ * by n bytes, so each round is sixteen lookups and XORs on the 32 bit columns.
+ */
+struct AESTables
 {
-  outLen = GetPaddingLength(inLen);
-  unsigned char *alignIn  = PaddingNulls(in, inLen, outLen);
-  unsigned char *roundKeys = new unsigned char[4 * Nb * (Nr + 1)];
-  KeyExpansion(key, roundKeys);
-  for (unsigned int i = 0; i < outLen; i+= blockBytesLen)
-  {
-    EncryptBlock(alignIn + i, in + i, roundKeys);
-  }
-  
-  delete[] alignIn;
-  delete[] roundKeys;
-  
-  return;
-}
+  uint32_t Te[4][256];
+  uint32_t Td[4][256];
 
-void AES::DecryptECB(unsigned char in[], unsigned int inLen, unsigned  char key[])
+  AESTables();
+};
+
+static unsigned char xtime(unsigned char b)    // multiply on x
 {
-  unsigned char *temp = new unsigned char[inLen];
-  unsigned char *roundKeys = new unsigned char[4 * Nb * (Nr + 1)];
-  KeyExpansion(key, roundKeys);
-  for (unsigned int i = 0; i < inLen; i+= blockBytesLen)
-  {
-    DecryptBlock(in + i, temp + i, roundKeys);
-  }
-  
-  memcpy(in, temp, inLen);
-  delete[] roundKeys;
-  delete[] temp;
-  return;
+  return (b << 1) ^ (((b >> 7) & 1) * 0x1b);
 }
 
-
-unsigned char *AES::EncryptCBC(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv, unsigned int &outLen)
+static unsigned char mul_bytes(unsigned char a, unsigned char b) // multiplication a and b in galois field
 {
-  outLen = GetPaddingLength(inLen);
-  unsigned char *alignIn  = PaddingNulls(in, inLen, outLen);
-  unsigned char *out = new unsigned char[outLen];
-  unsigned char *block = new unsigned char[blockBytesLen];
-  unsigned char *roundKeys = new unsigned char[4 * Nb * (Nr + 1)];
-  KeyExpansion(key, roundKeys);
-  memcpy(block, iv, blockBytesLen);
-  for (unsigned int i = 0; i < outLen; i+= blockBytesLen)
+  unsigned char p = 0;
+  for (int i = 0; i < 8; i++)
   {
-    XorBlocks(block, alignIn + i, block, blockBytesLen);
-    EncryptBlock(block, out + i, roundKeys);
-    memcpy(block, out + i, blockBytesLen);
+    if (b & 1)
+    {
+      p ^= a;
+    }
+    a = xtime(a);
+    b >>= 1;
   }
-  
-  delete[] block;
-  delete[] alignIn;
-  delete[] roundKeys;
 
-  return out;
+  return p;
 }
 
-unsigned char *AES::DecryptCBC(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv)
+static inline uint32_t rotr(uint32_t x, int n)
 {
-  unsigned char *out = new unsigned char[inLen];
-  unsigned char *block = new unsigned char[blockBytesLen];
-  unsigned char *roundKeys = new unsigned char[4 * Nb * (Nr + 1)];
-  KeyExpansion(key, roundKeys);
-  memcpy(block, iv, blockBytesLen);
-  for (unsigned int i = 0; i < inLen; i+= blockBytesLen)
-  {
-    DecryptBlock(in + i, out + i, roundKeys);
-    XorBlocks(block, out + i, out + i, blockBytesLen);
-    memcpy(block, in + i, blockBytesLen);
-  }
-  
-  delete[] block;
-  delete[] roundKeys;
-
-  return out;
+  return n ? (x >> n) | (x << (32 - n)) : x;
 }
 
-unsigned char *AES::EncryptCFB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv, unsigned int &outLen)
+AESTables::AESTables()
 {
-  outLen = GetPaddingLength(inLen);
-  unsigned char *alignIn  = PaddingNulls(in, inLen, outLen);
-  unsigned char *out = new unsigned char[outLen];
-  unsigned char *block = new unsigned char[blockBytesLen];
-  unsigned char *encryptedBlock = new unsigned char[blockBytesLen];
-  unsigned char *roundKeys = new unsigned char[4 * Nb * (Nr + 1)];
-  KeyExpansion(key, roundKeys);
-  memcpy(block, iv, blockBytesLen);
-  for (unsigned int i = 0; i < outLen; i+= blockBytesLen)
+  for (int x = 0; x < 256; x++)
   {
-    EncryptBlock(block, encryptedBlock, roundKeys);
-    XorBlocks(alignIn + i, encryptedBlock, out + i, blockBytesLen);
-    memcpy(block, out + i, blockBytesLen);
-  }
-  
-  delete[] block;
-  delete[] encryptedBlock;
-  delete[] alignIn;
-  delete[] roundKeys;
+    unsigned char s = sbox[x / 16][x % 16];
+    unsigned char is = inv_sbox[x / 16][x % 16];
+    uint32_t te = ((uint32_t) xtime(s) << 24) | ((uint32_t) s << 16) | ((uint32_t) s << 8) | (uint32_t) (xtime(s) ^ s);
+    uint32_t td = ((uint32_t) mul_bytes(is, 0x0e) << 24) | ((uint32_t) mul_bytes(is, 0x09) << 16) | ((uint32_t) mul_bytes(is, 0x0d) << 8) | (uint32_t) mul_bytes(is, 0x0b);
 
-  return out;
+    for (int n = 0; n < 4; n++)
+    {
+      Te[n][x] = rotr(te, 8 * n);
+      Td[n][x] = rotr(td, 8 * n);
+    }
+  }
 }
 
-unsigned char *AES::DecryptCFB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv)
+static const AESTables& tables()
 {
-  unsigned char *out = new unsigned char[inLen];
-  unsigned char *block = new unsigned char[blockBytesLen];
-  unsigned char *encryptedBlock = new unsigned char[blockBytesLen];
-  unsigned char *roundKeys = new unsigned char[4 * Nb * (Nr + 1)];
-  KeyExpansion(key, roundKeys);
-  memcpy(block, iv, blockBytesLen);
-  for (unsigned int i = 0; i < inLen; i+= blockBytesLen)
-  {
-    EncryptBlock(block, encryptedBlock, roundKeys);
-    XorBlocks(in + i, encryptedBlock, out + i, blockBytesLen);
-    memcpy(block, in + i, blockBytesLen);
-  }
-  
-  delete[] block;
-  delete[] encryptedBlock;
-  delete[] roundKeys;
+  static const AESTables t;
+  return t;
+}
 
-  return out;
+static inline uint32_t load32(const unsigned char *p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
 }
 
-unsigned char * AES::PaddingNulls(unsigned char in[], unsigned int inLen, unsigned int alignLen)
+static inline void store32(unsigned char *p, uint32_t x)
 {
-  unsigned char *alignIn = new unsigned char[alignLen];
-  memcpy(alignIn, in, inLen);
-  memset(alignIn + inLen, 0x00, alignLen - inLen);
-  return alignIn;
+  p[0] = x >> 24;
+  p[1] = x >> 16;
+  p[2] = x >> 8;
+  p[3] = x;
 }
 
-unsigned int AES::GetPaddingLength(unsigned int len)
+static inline uint32_t SubWord(uint32_t w)
 {
-  unsigned int lengthWithPadding =  (len / blockBytesLen);
-  if (len % blockBytesLen) {
-	  lengthWithPadding++;
-  }
-  
-  lengthWithPadding *=  blockBytesLen;
-  
-  return lengthWithPadding;
+  const unsigned char *s = &sbox[0][0];
+  return ((uint32_t) s[w >> 24] << 24) | ((uint32_t) s[(w >> 16) & 0xff] << 16) | ((uint32_t) s[(w >> 8) & 0xff] << 8) | (uint32_t) s[w & 0xff];
 }
 
-void AES::EncryptBlock(unsigned char in[], unsigned char out[], unsigned  char *roundKeys)
+template <int keyBits>
+void AESKey<keyBits>::expand(const unsigned char key[])
 {
-  unsigned char **state = new unsigned char *[4];
-  state[0] = new unsigned  char[4 * Nb];
-  int i, j, round;
-  for (i = 0; i < 4; i++)
+  const AESTables &t = tables();
+  uint32_t temp;
+  unsigned char rcon = 1;
+  int i;
+
+  for (i = 0; i < Nk; i++)
   {
-    state[i] = state[0] + Nb * i;
+    enc[i] = load32(key + 4 * i);
   }
 
-
-  for (i = 0; i < 4; i++)
+  for (i = Nk; i < words; i++)
   {
-    for (j = 0; j < Nb; j++)
+    temp = enc[i - 1];
+    if (i % Nk == 0)
     {
-      state[i][j] = in[i + 4 * j];
+      temp = SubWord(rotr(temp, 24)) ^ ((uint32_t) rcon << 24);
+      rcon = xtime(rcon);
     }
+    else if (Nk > 6 && i % Nk == 4)
+    {
+      temp = SubWord(temp);
+    }
+    enc[i] = enc[i - Nk] ^ temp;
   }
 
-  AddRoundKey(state, roundKeys);
-
-  for (round = 1; round <= Nr - 1; round++)
-  {
-    SubBytes(state);
-    ShiftRows(state);
-    MixColumns(state);
-    AddRoundKey(state, roundKeys + round * 4 * Nb);
-  }
-
-  SubBytes(state);
-  ShiftRows(state);
-  AddRoundKey(state, roundKeys + Nr * 4 * Nb);
-
-  for (i = 0; i < 4; i++)
+  //Equivalent inverse cipher: round keys in reverse, with InvMixColumns applied to the middle rounds
+  const unsigned char *s = &sbox[0][0];
+  for (int round = 0; round <= Nr; round++)
   {
-    for (j = 0; j < Nb; j++)
+    for (i = 0; i < 4; i++)
     {
-      out[i + 4 * j] = state[i][j];
+      uint32_t w = enc[4 * (Nr - round) + i];
+      if (round > 0 && round < Nr)
+      {
+        w = t.Td[0][s[w >> 24]] ^ t.Td[1][s[(w >> 16) & 0xff]] ^ t.Td[2][s[(w >> 8) & 0xff]] ^ t.Td[3][s[w & 0xff]];
+      }
+      dec[4 * round + i] = w;
     }
   }
-
-  delete[] state[0];
-  delete[] state;
 }
 
-void AES::DecryptBlock(unsigned char in[], unsigned char out[], unsigned  char *roundKeys)
+template <int keyBits>
+void AESKey<keyBits>::encrypt(const unsigned char in[16], unsigned char out[16]) const
 {
-  unsigned char **state = new unsigned char *[4];
-  state[0] = new unsigned  char[4 * Nb];
-  int i, j, round;
-  for (i = 0; i < 4; i++)
-  {
-    state[i] = state[0] + Nb * i;
-  }
+  const AESTables &t = tables();
+  const unsigned char *s = &sbox[0][0];
+  const uint32_t *rk = enc;
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
 
+  s0 = load32(in) ^ rk[0];
+  s1 = load32(in + 4) ^ rk[1];
+  s2 = load32(in + 8) ^ rk[2];
+  s3 = load32(in + 12) ^ rk[3];
 
-  for (i = 0; i < 4; i++)
+  for (int round = 1; round < Nr; round++)
   {
-    for (j = 0; j < Nb; j++) {
-      state[i][j] = in[i + 4 * j];
-    }
+    rk += 4;
+    t0 = t.Te[0][s0 >> 24] ^ t.Te[1][(s1 >> 16) & 0xff] ^ t.Te[2][(s2 >> 8) & 0xff] ^ t.Te[3][s3 & 0xff] ^ rk[0];
+    t1 = t.Te[0][s1 >> 24] ^ t.Te[1][(s2 >> 16) & 0xff] ^ t.Te[2][(s3 >> 8) & 0xff] ^ t.Te[3][s0 & 0xff] ^ rk[1];
+    t2 = t.Te[0][s2 >> 24] ^ t.Te[1][(s3 >> 16) & 0xff] ^ t.Te[2][(s0 >> 8) & 0xff] ^ t.Te[3][s1 & 0xff] ^ rk[2];
+    t3 = t.Te[0][s3 >> 24] ^ t.Te[1][(s0 >> 16) & 0xff] ^ t.Te[2][(s1 >> 8) & 0xff] ^ t.Te[3][s2 & 0xff] ^ rk[3];
+    s0 = t0; s1 = t1; s2 = t2; s3 = t3;
   }
 
-  AddRoundKey(state, roundKeys + Nr * 4 * Nb);
+  rk += 4;
+  store32(out, (((uint32_t) s[s0 >> 24] << 24) | ((uint32_t) s[(s1 >> 16) & 0xff] << 16) | ((uint32_t) s[(s2 >> 8) & 0xff] << 8) | s[s3 & 0xff]) ^ rk[0]);
+  store32(out + 4, (((uint32_t) s[s1 >> 24] << 24) | ((uint32_t) s[(s2 >> 16) & 0xff] << 16) | ((uint32_t) s[(s3 >> 8) & 0xff] << 8) | s[s0 & 0xff]) ^ rk[1]);
+  store32(out + 8, (((uint32_t) s[s2 >> 24] << 24) | ((uint32_t) s[(s3 >> 16) & 0xff] << 16) | ((uint32_t) s[(s0 >> 8) & 0xff] << 8) | s[s1 & 0xff]) ^ rk[2]);
+  store32(out + 12, (((uint32_t) s[s3 >> 24] << 24) | ((uint32_t) s[(s0 >> 16) & 0xff] << 16) | ((uint32_t) s[(s1 >> 8) & 0xff] << 8) | s[s2 & 0xff]) ^ rk[3]);
+}
 
-  for (round = Nr - 1; round >= 1; round--)
-  {
-    InvSubBytes(state);
-    InvShiftRows(state);
-    AddRoundKey(state, roundKeys + round * 4 * Nb);
-    InvMixColumns(state);
-  }
+template <int keyBits>
+void AESKey<keyBits>::decrypt(const unsigned char in[16], unsigned char out[16]) const
+{
+  const AESTables &t = tables();
+  const unsigned char *is = &inv_sbox[0][0];
+  const uint32_t *rk = dec;
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
 
-  InvSubBytes(state);
-  InvShiftRows(state);
-  AddRoundKey(state, roundKeys);
+  s0 = load32(in) ^ rk[0];
+  s1 = load32(in + 4) ^ rk[1];
+  s2 = load32(in + 8) ^ rk[2];
+  s3 = load32(in + 12) ^ rk[3];
 
-  for (i = 0; i < 4; i++)
+  for (int round = 1; round < Nr; round++)
   {
-    for (j = 0; j < Nb; j++) {
-      out[i + 4 * j] = state[i][j];
-    }
+    rk += 4;
+    t0 = t.Td[0][s0 >> 24] ^ t.Td[1][(s3 >> 16) & 0xff] ^ t.Td[2][(s2 >> 8) & 0xff] ^ t.Td[3][s1 & 0xff] ^ rk[0];
+    t1 = t.Td[0][s1 >> 24] ^ t.Td[1][(s0 >> 16) & 0xff] ^ t.Td[2][(s3 >> 8) & 0xff] ^ t.Td[3][s2 & 0xff] ^ rk[1];
+    t2 = t.Td[0][s2 >> 24] ^ t.Td[1][(s1 >> 16) & 0xff] ^ t.Td[2][(s0 >> 8) & 0xff] ^ t.Td[3][s3 & 0xff] ^ rk[2];
+    t3 = t.Td[0][s3 >> 24] ^ t.Td[1][(s2 >> 16) & 0xff] ^ t.Td[2][(s1 >> 8) & 0xff] ^ t.Td[3][s0 & 0xff] ^ rk[3];
+    s0 = t0; s1 = t1; s2 = t2; s3 = t3;
   }
 
-  delete[] state[0];
-  delete[] state;
+  rk += 4;
+  store32(out, (((uint32_t) is[s0 >> 24] << 24) | ((uint32_t) is[(s3 >> 16) & 0xff] << 16) | ((uint32_t) is[(s2 >> 8) & 0xff] << 8) | is[s1 & 0xff]) ^ rk[0]);
+  store32(out + 4, (((uint32_t) is[s1 >> 24] << 24) | ((uint32_t) is[(s0 >> 16) & 0xff] << 16) | ((uint32_t) is[(s3 >> 8) & 0xff] << 8) | is[s2 & 0xff]) ^ rk[1]);
+  store32(out + 8, (((uint32_t) is[s2 >> 24] << 24) | ((uint32_t) is[(s1 >> 16) & 0xff] << 16) | ((uint32_t) is[(s0 >> 8) & 0xff] << 8) | is[s3 & 0xff]) ^ rk[2]);
+  store32(out + 12, (((uint32_t) is[s3 >> 24] << 24) | ((uint32_t) is[(s2 >> 16) & 0xff] << 16) | ((uint32_t) is[(s1 >> 8) & 0xff] << 8) | is[s0 & 0xff]) ^ rk[3]);
 }
 
+template class AESKey<128>;
+template class AESKey<192>;
+template class AESKey<256>;
 
-void AES::SubBytes(unsigned char **state)
+bool AESHardware()
 {
-  int i, j;
-  unsigned char t;
-  for (i = 0; i < 4; i++)
-  {
-    for (j = 0; j < Nb; j++)
-    {
-      t = state[i][j];
-      state[i][j] = sbox[t / 16][t % 16];
-    }
-  }
-
+#ifdef AES_HAVE_NI
+  static const bool available = AESNIAvailable();
+  return available;
+#else
+  return false;
+#endif
 }
 
-void AES::ShiftRow(unsigned char **state, int i, int n)    // shift row i on n positions
-{
-  unsigned char *tmp = new unsigned char[Nb];
-  for (int j = 0; j < Nb; j++) {
-    tmp[j] = state[i][(j + n) % Nb];
-  }
-  memcpy(state[i], tmp, Nb * sizeof(unsigned char));
-	
-  delete[] tmp;
-}
+static bool useBitslice = false;
 
-void AES::ShiftRows(unsigned char **state)
+void AESUseBitslice(bool enable)
 {
-  ShiftRow(state, 1, 1);
-  ShiftRow(state, 2, 2);
-  ShiftRow(state, 3, 3);
+  useBitslice = enable;
 }
 
-unsigned char AES::xtime(unsigned char b)    // multiply on x
+//Only AES-128 has a bitsliced version
+template <int keyBits>
+static bool BitsliceBlocks(const AESKey<keyBits> *const [], const unsigned char *const [], unsigned char *const [], unsigned int, bool)
 {
-  return (b << 1) ^ (((b >> 7) & 1) * 0x1b);
+  return false;
 }
 
-
-
-/* Implementation taken from https://en.wikipedia.org/wiki/Rijndael_mix_columns#Implementation_example */
-void AES::MixSingleColumn(unsigned char *r) 
+static bool BitsliceBlocks(const AES128Key *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count, bool decrypting)
 {
-  unsigned char a[4];
-  unsigned char b[4];
-  unsigned char c;
-  unsigned char h;
-  /* The array 'a' is simply a copy of the input array 'r'
-  * The array 'b' is each element of the array 'a' multiplied by 2
-  * in Rijndael's Galois field
-  * a[n] ^ b[n] is element n multiplied by 3 in Rijndael's Galois field */ 
-  for(c=0;c<4;c++) 
+  if (!useBitslice || count < AES_BITSLICE_MIN_BLOCKS) return false;
+
+  if (decrypting)
+  {
+    AESBitsliceDecryptBlocks(keys, in, out, count);
+  }
+  else
   {
-    a[c] = r[c];
-    /* h is 0xff if the high bit of r[c] is set, 0 otherwise */
-    h = (unsigned char)((signed char)r[c] >> 7); /* arithmetic right shift, thus shifting in either zeros or ones */
-    b[c] = r[c] << 1; /* implicitly removes high bit because b[c] is an 8-bit char, so we xor by 0x1b and not 0x11b in the next line */
-    b[c] ^= 0x1B & h; /* Rijndael's Galois field */
+    AESBitsliceEncryptBlocks(keys, in, out, count);
   }
-  r[0] = b[0] ^ a[3] ^ a[2] ^ b[1] ^ a[1]; /* 2 * a0 + a3 + a2 + 3 * a1 */
-  r[1] = b[1] ^ a[0] ^ a[3] ^ b[2] ^ a[2]; /* 2 * a1 + a0 + a3 + 3 * a2 */
-  r[2] = b[2] ^ a[1] ^ a[0] ^ b[3] ^ a[3]; /* 2 * a2 + a1 + a0 + 3 * a3 */
-  r[3] = b[3] ^ a[2] ^ a[1] ^ b[0] ^ a[0]; /* 2 * a3 + a2 + a1 + 3 * a0 */
+  return true;
 }
 
-/* Performs the mix columns step. Theory from: https://en.wikipedia.org/wiki/Advanced_Encryption_Standard#The_MixColumns_step */
-void AES::MixColumns(unsigned char** state) 
+template <int keyBits>
+void AESEncryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count)
 {
-  unsigned char *temp = new unsigned char[4];
+#ifdef AES_HAVE_NI
+  if (AESHardware())
+  {
+    AESNIEncryptBlocks(keys, in, out, count);
+    return;
+  }
+#endif
 
-  for(int i = 0; i < 4; ++i)
+  if (BitsliceBlocks(keys, in, out, count, false)) return;
+
+  for (unsigned int i = 0; i < count; i++)
   {
-    for(int j = 0; j < 4; ++j)
-    {
-      temp[j] = state[j][i]; //place the current state column in temp
-    }
-    MixSingleColumn(temp); //mix it using the wiki implementation
-    for(int j = 0; j < 4; ++j)
-    {
-      state[j][i] = temp[j]; //when the column is mixed, place it back into the state
-    }
+    keys[i]->encrypt(in[i], out[i]);
   }
-  delete[] temp;
 }
 
-void AES::AddRoundKey(unsigned char **state, unsigned char *key)
+template <int keyBits>
+void AESDecryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count)
 {
-  int i, j;
-  for (i = 0; i < 4; i++)
+#ifdef AES_HAVE_NI
+  if (AESHardware())
   {
-    for (j = 0; j < Nb; j++)
-    {
-      state[i][j] = state[i][j] ^ key[i + 4 * j];
-    }
+    AESNIDecryptBlocks(keys, in, out, count);
+    return;
+  }
+#endif
+
+  if (BitsliceBlocks(keys, in, out, count, true)) return;
+
+  for (unsigned int i = 0; i < count; i++)
+  {
+    keys[i]->decrypt(in[i], out[i]);
   }
 }
 
-void AES::SubWord(unsigned char *a)
+template void AESEncryptBlocks<128>(const AESKey<128> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESEncryptBlocks<192>(const AESKey<192> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESEncryptBlocks<256>(const AESKey<256> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESDecryptBlocks<128>(const AESKey<128> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESDecryptBlocks<192>(const AESKey<192> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESDecryptBlocks<256>(const AESKey<256> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+static inline void XorBlocks(const unsigned char *a, const unsigned char *b, unsigned char *c, unsigned int len)
 {
-  int i;
-  for (i = 0; i < 4; i++)
+  for (unsigned int i = 0; i < len; i++)
   {
-    a[i] = sbox[a[i] / 16][a[i] % 16];
+    c[i] = a[i] ^ b[i];
   }
 }
 
-void AES::RotWord(unsigned char *a)
+/*
+ * Copies up to a block of input, padding the rest with nulls
+ */
+static inline void PaddedBlock(const unsigned char *in, unsigned int remaining, unsigned char block[16])
 {
-  unsigned char c = a[0];
-  a[0] = a[1];
-  a[1] = a[2];
-  a[2] = a[3];
-  a[3] = c;
+  unsigned int n = remaining < 16 ? remaining : 16;
+  memcpy(block, in, n);
+  memset(block + n, 0x00, 16 - n);
 }
 
-void AES::XorWords(unsigned char *a, unsigned char *b, unsigned char *c)
+template <int keyBits>
+void AES::EncryptECB(unsigned char in[], unsigned int inLen, const unsigned char key[])
 {
-  int i;
-  for (i = 0; i < 4; i++)
+  AESKey<keyBits> roundKeys(key);
+  unsigned char block[16];
+
+  for (unsigned int i = 0; i < inLen; i += blockBytesLen)
   {
-    c[i] = a[i] ^ b[i];
+    PaddedBlock(in + i, inLen - i, block);
+    roundKeys.encrypt(block, in + i);
   }
 }
 
-void AES::Rcon(unsigned char * a, int n)
+template <int keyBits>
+void AES::DecryptECB(unsigned char in[], unsigned int inLen, const unsigned char key[])
 {
-  int i;
-  unsigned char c = 1;
-  for (i = 0; i < n - 1; i++)
+  AESKey<keyBits> roundKeys(key);
+
+  for (unsigned int i = 0; i < inLen; i += blockBytesLen)
   {
-    c = xtime(c);
+    roundKeys.decrypt(in + i, in + i);
   }
+}
 
-  a[0] = c;
-  a[1] = a[2] = a[3] = 0;
+template <int keyBits>
+AESCBC<keyBits>::AESCBC(const AESKey<keyBits> &key, const unsigned char iv[16]) : key(&key)
+{
+  reset(iv);
 }
 
-void AES::KeyExpansion(unsigned char key[], unsigned char w[])
+template <int keyBits>
+void AESCBC<keyBits>::reset(const unsigned char iv[16])
 {
-  unsigned char *temp = new unsigned char[4];
-  unsigned char *rcon = new unsigned char[4];
+  memcpy(this->iv, iv, 16);
+}
+
+template <int keyBits>
+void AESCBC<keyBits>::encrypt(const unsigned char in[], unsigned int inLen, unsigned char out[])
+{
+  unsigned char block[16];
 
-  int i = 0;
-  while (i < 4 * Nk)
+  for (unsigned int i = 0; i < inLen; i += 16)
   {
-    w[i] = key[i];
-    i++;
+    PaddedBlock(in + i, inLen - i, block);
+    XorBlocks(iv, block, block, 16);
+    key->encrypt(block, out + i);
+    memcpy(iv, out + i, 16);
   }
+}
+
+template <int keyBits>
+void AESCBC<keyBits>::decrypt(const unsigned char in[], unsigned int inLen, unsigned char out[])
+{
+  unsigned char block[16];
 
-  i = 4 * Nk;
-  while (i < 4 * Nb * (Nr + 1))
+  for (unsigned int i = 0; i + 16 <= inLen; i += 16)
   {
-    temp[0] = w[i - 4 + 0];
-    temp[1] = w[i - 4 + 1];
-    temp[2] = w[i - 4 + 2];
-    temp[3] = w[i - 4 + 3];
+    //Keep the ciphertext, since out may be overwriting it
+    memcpy(block, in + i, 16);
+    key->decrypt(block, out + i);
+    XorBlocks(iv, out + i, out + i, 16);
+    memcpy(iv, block, 16);
+  }
+}
 
-    if (i / 4 % Nk == 0)
-    {
-        RotWord(temp);
-        SubWord(temp);
-        Rcon(rcon, i / (Nk * 4));
-        XorWords(temp, rcon, temp);
-    }
-    else if (Nk > 6 && i / 4 % Nk == 4)
+template <int keyBits>
+AESCFB<keyBits>::AESCFB(const AESKey<keyBits> &key, const unsigned char iv[16]) : key(&key)
+{
+  reset(iv);
+}
+
+template <int keyBits>
+void AESCFB<keyBits>::reset(const unsigned char iv[16])
+{
+  memcpy(shift, iv, 16);
+  used = 16;
+}
+
+template <int keyBits>
+template <bool encrypting>
+void AESCFB<keyBits>::run(const unsigned char in[], unsigned int inLen, unsigned char out[])
+{
+  for (unsigned int i = 0; i < inLen; i++)
+  {
+    if (used == 16)
     {
-      SubWord(temp);
+      key->encrypt(shift, keystream);
+      used = 0;
     }
 
-    w[i + 0] = w[i - 4 * Nk] ^ temp[0];
-    w[i + 1] = w[i + 1 - 4 * Nk] ^ temp[1];
-    w[i + 2] = w[i + 2 - 4 * Nk] ^ temp[2];
-    w[i + 3] = w[i + 3 - 4 * Nk] ^ temp[3];
-    i += 4;
+    unsigned char c = encrypting ? in[i] ^ keystream[used] : in[i];
+    out[i] = in[i] ^ keystream[used];
+    shift[used++] = c;
   }
+}
 
-  delete []rcon;
-  delete []temp;
+template <int keyBits>
+void AESCFB<keyBits>::encrypt(const unsigned char in[], unsigned int inLen, unsigned char out[])
+{
+  run<true>(in, inLen, out);
+}
 
+template <int keyBits>
+void AESCFB<keyBits>::decrypt(const unsigned char in[], unsigned int inLen, unsigned char out[])
+{
+  run<false>(in, inLen, out);
 }
 
+template class AESCBC<128>;
+template class AESCBC<192>;
+template class AESCBC<256>;
+template class AESCFB<128>;
+template class AESCFB<192>;
+template class AESCFB<256>;
+
+template <int keyBits>
+void AES::CBC(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[], bool encrypting)
+{
+  AESKey<keyBits> roundKeys(key);
+  AESCBC<keyBits> cbc(roundKeys, iv);
+
+  if (encrypting)
+  {
+    cbc.encrypt(in, inLen, out);
+  }
+  else
+  {
+    cbc.decrypt(in, inLen, out);
+  }
+}
 
-void AES::InvSubBytes(unsigned char **state)
+template <int keyBits>
+void AES::CFB(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[], bool encrypting)
 {
-  int i, j;
-  unsigned char t;
-  for (i = 0; i < 4; i++)
+  AESKey<keyBits> roundKeys(key);
+  AESCFB<keyBits> cfb(roundKeys, iv);
+
+  if (encrypting)
   {
-    for (j = 0; j < Nb; j++)
+    //The old interface pads the last block with nulls and returns all of it
+    unsigned int whole = inLen - inLen % blockBytesLen;
+    cfb.encrypt(in, whole, out);
+    if (whole < inLen)
     {
-      t = state[i][j];
-      state[i][j] = inv_sbox[t / 16][t % 16];
+      unsigned char block[16];
+      PaddedBlock(in + whole, inLen - whole, block);
+      cfb.encrypt(block, blockBytesLen, out + whole);
     }
   }
+  else
+  {
+    cfb.decrypt(in, inLen, out);
+  }
 }
 
+/*
+ * Picks the instantiation for the key length given to the constructor
+ */
+#define AES_DISPATCH(method, ...) \
+  switch (Nk) \
+  { \
+  case 4: method<128>(__VA_ARGS__); break; \
+  case 6: method<192>(__VA_ARGS__); break; \
+  default: method<256>(__VA_ARGS__); break; \
+  }
 
-unsigned char AES::mul_bytes(unsigned char a, unsigned char b) // multiplication a and b in galois field
+//Encrypted in place, so in needs room for GetPaddingLength(inLen) bytes.  The last argument is only there for old
+//callers (which pass anything, often 0) and is ignored.
+void AES::EncryptECB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned int)
 {
-    unsigned char p = 0;
-    unsigned char high_bit_mask = 0x80;
-    unsigned char high_bit = 0;
-    unsigned char modulo = 0x1B; /* x^8 + x^4 + x^3 + x + 1 */
+  AES_DISPATCH(EncryptECB, in, inLen, key);
+}
 
+void AES::DecryptECB(unsigned char in[], unsigned int inLen, unsigned  char key[])
+{
+  AES_DISPATCH(DecryptECB, in, inLen, key);
+}
 
-    for (int i = 0; i < 8; i++) {
-      if (b & 1) {
-           p ^= a;
-      }
+unsigned char *AES::EncryptCBC(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv, unsigned int &outLen)
+{
+  outLen = GetPaddingLength(inLen);
+  unsigned char *out = new unsigned char[outLen];
+  EncryptCBC(in, inLen, key, iv, out);
+  return out;
+}
 
-      high_bit = a & high_bit_mask;
-      a <<= 1;
-      if (high_bit) {
-          a ^= modulo;
-      }
-      b >>= 1;
-    }
+unsigned char *AES::DecryptCBC(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv)
+{
+  unsigned char *out = new unsigned char[inLen];
+  DecryptCBC(in, inLen, key, iv, out);
+  return out;
+}
 
-    return p;
+unsigned char *AES::EncryptCFB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv, unsigned int &outLen)
+{
+  outLen = GetPaddingLength(inLen);
+  unsigned char *out = new unsigned char[outLen];
+  EncryptCFB(in, inLen, key, iv, out);
+  return out;
 }
 
+unsigned char *AES::DecryptCFB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv)
+{
+  unsigned char *out = new unsigned char[inLen];
+  DecryptCFB(in, inLen, key, iv, out);
+  return out;
+}
 
-void AES::InvMixColumns(unsigned char **state)
+void AES::EncryptCBC(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[])
 {
-  unsigned char s[4], s1[4];
-  int i, j;
+  AES_DISPATCH(CBC, in, inLen, key, iv, out, true);
+}
 
-  for (j = 0; j < Nb; j++)
-  {
-    for (i = 0; i < 4; i++)
-    {
-      s[i] = state[i][j];
-    }
-    s1[0] = mul_bytes(0x0e, s[0]) ^ mul_bytes(0x0b, s[1]) ^ mul_bytes(0x0d, s[2]) ^ mul_bytes(0x09, s[3]);
-    s1[1] = mul_bytes(0x09, s[0]) ^ mul_bytes(0x0e, s[1]) ^ mul_bytes(0x0b, s[2]) ^ mul_bytes(0x0d, s[3]);
-    s1[2] = mul_bytes(0x0d, s[0]) ^ mul_bytes(0x09, s[1]) ^ mul_bytes(0x0e, s[2]) ^ mul_bytes(0x0b, s[3]);
-    s1[3] = mul_bytes(0x0b, s[0]) ^ mul_bytes(0x0d, s[1]) ^ mul_bytes(0x09, s[2]) ^ mul_bytes(0x0e, s[3]);
+void AES::DecryptCBC(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[])
+{
+  AES_DISPATCH(CBC, in, inLen, key, iv, out, false);
+}
 
-    for (i = 0; i < 4; i++)
-    {
-      state[i][j] = s1[i];
-    }
-  }
+void AES::EncryptCFB(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[])
+{
+  AES_DISPATCH(CFB, in, inLen, key, iv, out, true);
 }
 
-void AES::InvShiftRows(unsigned char **state)
+void AES::DecryptCFB(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[])
 {
-  ShiftRow(state, 1, Nb - 1);
-  ShiftRow(state, 2, Nb - 2);
-  ShiftRow(state, 3, Nb - 3);
+  AES_DISPATCH(CFB, in, inLen, key, iv, out, false);
 }
 
-void AES::XorBlocks(unsigned char *a, unsigned char * b, unsigned char *c, unsigned int len)
+unsigned int AES::GetPaddingLength(unsigned int len)
 {
-  for (unsigned int i = 0; i < len; i++)
-  {
-    c[i] = a[i] ^ b[i];
+  unsigned int lengthWithPadding =  (len / blockBytesLen);
+  if (len % blockBytesLen) {
+	  lengthWithPadding++;
   }
+  
+  lengthWithPadding *=  blockBytesLen;
+  
+  return lengthWithPadding;
 }
 
 void AES::printHexArray (unsigned char a[], unsigned int n)
@@ -2,61 +2,135 @@
 #define _AES_H_
 
 #include <cstring>
+#include <stdint.h>
 #include <iostream>
 #include <stdio.h>
 
 using namespace std;
 
-class AES
+/*
+ * Expanded key for one AES key size, fixed at compile time so the round loops
+ * have constant bounds.  Holds both the encryption schedule and the equivalent
+ * inverse cipher schedule, so a key expanded once can be reused for any number
+ * of blocks.  Nothing is allocated; the object lives wherever the caller puts it.
+ */
+template <int keyBits>
+class AESKey
 {
-private:
-  int Nb;
-  int Nk;
-  int Nr;
+  static_assert(keyBits == 128 || keyBits == 192 || keyBits == 256, "AES keys are 128, 192 or 256 bits");
 
-  unsigned int blockBytesLen;
+public:
+  static constexpr int Nk = keyBits / 32;
+  static constexpr int Nr = Nk + 6;
+  static constexpr int words = 4 * (Nr + 1);
 
-  void SubBytes(unsigned char **state);
+  AESKey() {}
+  AESKey(const unsigned char key[]) { expand(key); }
 
-  void ShiftRow(unsigned char **state, int i, int n);    // shift row i on n positions
+  void expand(const unsigned char key[]);
 
-  void ShiftRows(unsigned char **state);
+  void encrypt(const unsigned char in[16], unsigned char out[16]) const;
 
-  unsigned char xtime(unsigned char b);    // multiply on x
+  void decrypt(const unsigned char in[16], unsigned char out[16]) const;
 
-  unsigned char mul_bytes(unsigned char a, unsigned char b);
+  uint32_t enc[words];
+  uint32_t dec[words];
+};
 
-  void MixColumns(unsigned char **state);
+typedef AESKey<128> AES128Key;
+typedef AESKey<192> AES192Key;
+typedef AESKey<256> AES256Key;
+
+/*
+ * Encrypts or decrypts count independent blocks, block i with *keys[i].  in and out
+ * may point at the same blocks.  Uses AES-NI when the CPU has it, interleaving
+ * several blocks so their rounds overlap; otherwise the table code one at a time.
+ */
+template <int keyBits>
+void AESEncryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+template <int keyBits>
+void AESDecryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+bool AESHardware();
+
+/*
+ * Without AES-NI the batch functions use the table code.  AESUseBitslice(true) sends
+ * AES-128 batches of 8 or more blocks to the bitsliced code instead,
+ * which has no key or data dependent memory accesses but measures slower than warm tables.
+ */
+void AESUseBitslice(bool enable);
+
+/*
+ * CBC and CFB over caller buffers, using a key expanded elsewhere.  The chaining
+ * value is carried between calls, so a message can be fed through in pieces and
+ * nothing is ever allocated.  out may be the same buffer as in.
+ *
+ * CBC works on whole blocks; a short final piece is padded with nulls, so out needs
+ * room for the rounded up length.  CFB runs as a stream cipher and takes any length.
+ */
+template <int keyBits>
+class AESCBC
+{
+public:
+  AESCBC(const AESKey<keyBits> &key, const unsigned char iv[16]);
 
-  void MixSingleColumn(unsigned char *r);
+  void reset(const unsigned char iv[16]);
 
-  void AddRoundKey(unsigned char **state, unsigned char *key);
+  void encrypt(const unsigned char in[], unsigned int inLen, unsigned char out[]);
 
-  void SubWord(unsigned char *a);
+  void decrypt(const unsigned char in[], unsigned int inLen, unsigned char out[]);
 
-  void RotWord(unsigned char *a);
+  //IV to carry on from in a later session
+  const unsigned char *chain() const { return iv; }
 
-  void XorWords(unsigned char *a, unsigned char *b, unsigned char *c);
+private:
+  const AESKey<keyBits> *key;
+  unsigned char iv[16];
+};
 
-  void Rcon(unsigned char * a, int n);
+template <int keyBits>
+class AESCFB
+{
+public:
+  AESCFB(const AESKey<keyBits> &key, const unsigned char iv[16]);
 
-  void InvSubBytes(unsigned char **state);
+  void reset(const unsigned char iv[16]);
 
-  void InvMixColumns(unsigned char **state);
+  void encrypt(const unsigned char in[], unsigned int inLen, unsigned char out[]);
 
-  void InvShiftRows(unsigned char **state);
+  void decrypt(const unsigned char in[], unsigned int inLen, unsigned char out[]);
 
-  unsigned char* PaddingNulls(unsigned char in[], unsigned int inLen, unsigned int alignLen);
-  
-  unsigned int GetPaddingLength(unsigned int len);
+private:
+  const AESKey<keyBits> *key;
+  unsigned char shift[16];     //Feedback register, filled with ciphertext as it's produced
+  unsigned char keystream[16];
+  unsigned int used;           //Keystream bytes already spent
 
-  void KeyExpansion(unsigned char key[], unsigned char w[]);
+  template <bool encrypting>
+  void run(const unsigned char in[], unsigned int inLen, unsigned char out[]);
+};
 
-  void EncryptBlock(unsigned char in[], unsigned char out[], unsigned  char key[]);
+class AES
+{
+private:
+  int Nb;
+  int Nk;
+  int Nr;
+
+  unsigned int blockBytesLen;
 
-  void DecryptBlock(unsigned char in[], unsigned char out[], unsigned  char key[]);
+  template <int keyBits>
+  void EncryptECB(unsigned char in[], unsigned int inLen, const unsigned char key[]);
 
-  void XorBlocks(unsigned char *a, unsigned char * b, unsigned char *c, unsigned int len);
+  template <int keyBits>
+  void DecryptECB(unsigned char in[], unsigned int inLen, const unsigned char key[]);
+
+  template <int keyBits>
+  void CBC(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[], bool encrypting);
+
+  template <int keyBits>
+  void CFB(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[], bool encrypting);
 
 public:
   AES(int keyLen = 256);
@@ -72,6 +146,17 @@ public:
   unsigned char *EncryptCFB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv, unsigned int &outLen);
 
   unsigned char *DecryptCFB(unsigned char in[], unsigned int inLen, unsigned  char key[], unsigned char * iv);
+
+  //Caller buffer versions.  out may be in, and needs GetPaddingLength(inLen) bytes when encrypting.
+  void EncryptCBC(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[]);
+
+  void DecryptCBC(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[]);
+
+  void EncryptCFB(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[]);
+
+  void DecryptCFB(const unsigned char in[], unsigned int inLen, const unsigned char key[], const unsigned char *iv, unsigned char out[]);
+
+  unsigned int GetPaddingLength(unsigned int len);
   
   void printHexArray (unsigned char a[], unsigned int n);
 
@@ -0,0 +1,549 @@
+#include "AESBitslice.h"
+
+/*
+ * Layout follows the usual 64 bit bitsliced AES: four blocks share a set of eight
+ * 64 bit words, word n holding bit n of every byte, ordered so ShiftRows and
+ * MixColumns become shifts and rotations within a word.  Here each word is a vector
+ * of four of those, so one pass covers sixteen blocks.
+ */
+typedef uint64_t BitsliceWide __attribute__((vector_size(32)));
+typedef uint64_t BitsliceNarrow __attribute__((vector_size(16)));
+
+#if defined(__x86_64__) && defined(__linux__)
+#define AES_BITSLICE_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define AES_BITSLICE_CLONES
+#endif
+
+#define BITSLICE_INLINE template <class BitsliceWord> static inline __attribute__((always_inline))
+
+/*
+ * S-box as a boolean circuit (Boyar and Peralta's 113 gate version)
+ */
+BITSLICE_INLINE void Sbox(BitsliceWord *q)
+{
+  BitsliceWord x0, x1, x2, x3, x4, x5, x6, x7;
+  BitsliceWord y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+  BitsliceWord z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+  BitsliceWord t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+  BitsliceWord t20, t21, t22, t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+  BitsliceWord t40, t41, t42, t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+  BitsliceWord t60, t61, t62, t63, t64, t65, t66, t67;
+  BitsliceWord s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7];
+  x1 = q[6];
+  x2 = q[5];
+  x3 = q[4];
+  x4 = q[3];
+  x5 = q[2];
+  x6 = q[1];
+  x7 = q[0];
+
+  //Top linear transformation
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  //Non-linear section
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  //Bottom linear transformation
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+/*
+ * Inverse affine transform (with the 0x63 constant), which turns the S-box circuit into the inverse S-box
+ */
+BITSLICE_INLINE void InvAffine(BitsliceWord *q)
+{
+  BitsliceWord q0, q1, q2, q3, q4, q5, q6, q7;
+
+  q0 = ~q[0];
+  q1 = ~q[1];
+  q2 = q[2];
+  q3 = q[3];
+  q4 = q[4];
+  q5 = ~q[5];
+  q6 = ~q[6];
+  q7 = q[7];
+  q[7] = q1 ^ q4 ^ q6;
+  q[6] = q0 ^ q3 ^ q5;
+  q[5] = q7 ^ q2 ^ q4;
+  q[4] = q6 ^ q1 ^ q3;
+  q[3] = q5 ^ q0 ^ q2;
+  q[2] = q4 ^ q7 ^ q1;
+  q[1] = q3 ^ q6 ^ q0;
+  q[0] = q2 ^ q5 ^ q7;
+}
+
+BITSLICE_INLINE void InvSbox(BitsliceWord *q)
+{
+  InvAffine(q);
+  Sbox(q);
+  InvAffine(q);
+}
+
+/*
+ * Moves between one byte per lane position and one bit per word
+ */
+BITSLICE_INLINE void Ortho(BitsliceWord *q)
+{
+#define BITSLICE_SWAP(cl, ch, s, x, y) { \
+    BitsliceWord a = (x), b = (y); \
+    (x) = (a & (uint64_t) cl) | ((b & (uint64_t) cl) << (s)); \
+    (y) = ((a & (uint64_t) ch) >> (s)) | (b & (uint64_t) ch); \
+  }
+#define BITSLICE_SWAP2(x, y) BITSLICE_SWAP(0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1, x, y)
+#define BITSLICE_SWAP4(x, y) BITSLICE_SWAP(0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2, x, y)
+#define BITSLICE_SWAP8(x, y) BITSLICE_SWAP(0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4, x, y)
+
+  BITSLICE_SWAP2(q[0], q[1]);
+  BITSLICE_SWAP2(q[2], q[3]);
+  BITSLICE_SWAP2(q[4], q[5]);
+  BITSLICE_SWAP2(q[6], q[7]);
+
+  BITSLICE_SWAP4(q[0], q[2]);
+  BITSLICE_SWAP4(q[1], q[3]);
+  BITSLICE_SWAP4(q[4], q[6]);
+  BITSLICE_SWAP4(q[5], q[7]);
+
+  BITSLICE_SWAP8(q[0], q[4]);
+  BITSLICE_SWAP8(q[1], q[5]);
+  BITSLICE_SWAP8(q[2], q[6]);
+  BITSLICE_SWAP8(q[3], q[7]);
+}
+
+/*
+ * Spreads one block's four little endian words over a pair of 64 bit words, and back
+ */
+static inline void InterleaveIn(uint64_t *q0, uint64_t *q1, const uint32_t *w)
+{
+  uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+
+  x0 |= (x0 << 16);
+  x1 |= (x1 << 16);
+  x2 |= (x2 << 16);
+  x3 |= (x3 << 16);
+  x0 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x1 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x2 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x3 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x0 |= (x0 << 8);
+  x1 |= (x1 << 8);
+  x2 |= (x2 << 8);
+  x3 |= (x3 << 8);
+  x0 &= (uint64_t) 0x00FF00FF00FF00FF;
+  x1 &= (uint64_t) 0x00FF00FF00FF00FF;
+  x2 &= (uint64_t) 0x00FF00FF00FF00FF;
+  x3 &= (uint64_t) 0x00FF00FF00FF00FF;
+  *q0 = x0 | (x2 << 8);
+  *q1 = x1 | (x3 << 8);
+}
+
+static inline void InterleaveOut(uint32_t *w, uint64_t q0, uint64_t q1)
+{
+  uint64_t x0, x1, x2, x3;
+
+  x0 = q0 & (uint64_t) 0x00FF00FF00FF00FF;
+  x1 = q1 & (uint64_t) 0x00FF00FF00FF00FF;
+  x2 = (q0 >> 8) & (uint64_t) 0x00FF00FF00FF00FF;
+  x3 = (q1 >> 8) & (uint64_t) 0x00FF00FF00FF00FF;
+  x0 |= (x0 >> 8);
+  x1 |= (x1 >> 8);
+  x2 |= (x2 >> 8);
+  x3 |= (x3 >> 8);
+  x0 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x1 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x2 &= (uint64_t) 0x0000FFFF0000FFFF;
+  x3 &= (uint64_t) 0x0000FFFF0000FFFF;
+  w[0] = (uint32_t) x0 | (uint32_t) (x0 >> 16);
+  w[1] = (uint32_t) x1 | (uint32_t) (x1 >> 16);
+  w[2] = (uint32_t) x2 | (uint32_t) (x2 >> 16);
+  w[3] = (uint32_t) x3 | (uint32_t) (x3 >> 16);
+}
+
+static inline uint32_t load32le(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void store32le(unsigned char *p, uint32_t x)
+{
+  p[0] = x;
+  p[1] = x >> 8;
+  p[2] = x >> 16;
+  p[3] = x >> 24;
+}
+
+//AESKey keeps round keys as big endian column words
+static inline uint32_t swap32(uint32_t x)
+{
+  return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+/*
+ * Packs sixteen 16 byte values (blocks or round keys, as little endian words) into bitsliced form
+ */
+BITSLICE_INLINE void Pack(BitsliceWord *q, const uint32_t w[][4])
+{
+  static const int width = sizeof(BitsliceWord) / sizeof(uint64_t);
+  uint64_t lanes[8][width];
+
+  for (int lane = 0; lane < width; lane++)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      InterleaveIn(&lanes[i][lane], &lanes[i + 4][lane], w[4 * lane + i]);
+    }
+  }
+
+  memcpy(q, lanes, sizeof(lanes));
+  Ortho(q);
+}
+
+BITSLICE_INLINE void Unpack(uint32_t w[][4], BitsliceWord *q)
+{
+  static const int width = sizeof(BitsliceWord) / sizeof(uint64_t);
+  uint64_t lanes[8][width];
+
+  Ortho(q);
+  memcpy(lanes, q, sizeof(lanes));
+
+  for (int lane = 0; lane < width; lane++)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      InterleaveOut(w[4 * lane + i], lanes[i][lane], lanes[i + 4][lane]);
+    }
+  }
+}
+
+BITSLICE_INLINE void AddRoundKey(BitsliceWord *q, const BitsliceWord *sk)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    q[i] ^= sk[i];
+  }
+}
+
+/*
+ * Row r turns right by 4r bits within its 16 bits: rows 2 and 3 by a byte, then rows 1 and 3 by a nibble
+ */
+BITSLICE_INLINE void ShiftRows(BitsliceWord *q)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    BitsliceWord x = q[i];
+    x = (x & (uint64_t) 0x00000000FFFFFFFF)
+      | ((x >> 8) & (uint64_t) 0x00FF00FF00000000)
+      | ((x << 8) & (uint64_t) 0xFF00FF0000000000);
+    q[i] = (x & (uint64_t) 0x0000FFFF0000FFFF)
+      | ((x >> 4) & (uint64_t) 0x0FFF00000FFF0000)
+      | ((x << 12) & (uint64_t) 0xF0000000F0000000);
+  }
+}
+
+BITSLICE_INLINE void InvShiftRows(BitsliceWord *q)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    BitsliceWord x = q[i];
+    x = (x & (uint64_t) 0x00000000FFFFFFFF)
+      | ((x >> 8) & (uint64_t) 0x00FF00FF00000000)
+      | ((x << 8) & (uint64_t) 0xFF00FF0000000000);
+    q[i] = (x & (uint64_t) 0x0000FFFF0000FFFF)
+      | ((x << 4) & (uint64_t) 0xFFF00000FFF00000)
+      | ((x >> 12) & (uint64_t) 0x000F0000000F0000);
+  }
+}
+
+#define BITSLICE_ROTR16(x) (((x) >> 16) | ((x) << 48))
+#define BITSLICE_ROTR32(x) (((x) >> 32) | ((x) << 32))
+
+BITSLICE_INLINE void MixColumns(BitsliceWord *q)
+{
+  BitsliceWord q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+  BitsliceWord r0 = BITSLICE_ROTR16(q0), r1 = BITSLICE_ROTR16(q1), r2 = BITSLICE_ROTR16(q2), r3 = BITSLICE_ROTR16(q3);
+  BitsliceWord r4 = BITSLICE_ROTR16(q4), r5 = BITSLICE_ROTR16(q5), r6 = BITSLICE_ROTR16(q6), r7 = BITSLICE_ROTR16(q7);
+
+  q[0] = q7 ^ r7 ^ r0 ^ BITSLICE_ROTR32(q0 ^ r0);
+  q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ BITSLICE_ROTR32(q1 ^ r1);
+  q[2] = q1 ^ r1 ^ r2 ^ BITSLICE_ROTR32(q2 ^ r2);
+  q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ BITSLICE_ROTR32(q3 ^ r3);
+  q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ BITSLICE_ROTR32(q4 ^ r4);
+  q[5] = q4 ^ r4 ^ r5 ^ BITSLICE_ROTR32(q5 ^ r5);
+  q[6] = q5 ^ r5 ^ r6 ^ BITSLICE_ROTR32(q6 ^ r6);
+  q[7] = q6 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q7 ^ r7);
+}
+
+BITSLICE_INLINE void InvMixColumns(BitsliceWord *q)
+{
+  BitsliceWord q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+  BitsliceWord r0 = BITSLICE_ROTR16(q0), r1 = BITSLICE_ROTR16(q1), r2 = BITSLICE_ROTR16(q2), r3 = BITSLICE_ROTR16(q3);
+  BitsliceWord r4 = BITSLICE_ROTR16(q4), r5 = BITSLICE_ROTR16(q5), r6 = BITSLICE_ROTR16(q6), r7 = BITSLICE_ROTR16(q7);
+
+  q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ BITSLICE_ROTR32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+  q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+  q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+  q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^ BITSLICE_ROTR32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+  q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+  q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+  q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+  q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ BITSLICE_ROTR32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+/*
+ * AES-128 key schedule run on bitsliced keys, so only the raw keys need packing.
+ * Bits sit at row * 16 + column * 4 + lane, which makes RotWord a 16 bit rotation
+ * and the running XOR along the columns two masked shifts.
+ */
+BITSLICE_INLINE void ExpandKey(BitsliceWord sk[][8])
+{
+  static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+
+  for (int round = 1; round <= 10; round++)
+  {
+    BitsliceWord t[8];
+
+    for (int n = 0; n < 8; n++)
+    {
+      t[n] = sk[round - 1][n];
+    }
+    Sbox(t);
+
+    for (int n = 0; n < 8; n++)
+    {
+      //SubWord(RotWord(column 3)) into column 0, then copied to every column
+      BitsliceWord x = BITSLICE_ROTR16(t[n] & (uint64_t) 0xF000F000F000F000) >> 12;
+      if ((rcon[round - 1] >> n) & 0x01) x ^= (uint64_t) 0x000000000000000F;
+      x |= (x << 4);
+      x |= (x << 8);
+
+      BitsliceWord k = sk[round - 1][n];
+      k ^= (k << 4) & (uint64_t) 0xFFF0FFF0FFF0FFF0;
+      k ^= (k << 8) & (uint64_t) 0xFF00FF00FF00FF00;
+
+      sk[round][n] = k ^ x;
+    }
+  }
+}
+
+/*
+ * One pass over four blocks per vector lane.  key[i] is block i's AES-128 key as little
+ * endian words.  The bitsliced cipher uses the forward schedule in both directions.
+ */
+template <class BitsliceWord>
+AES_BITSLICE_CLONES
+static void BitslicePass(const uint32_t key[][4], uint32_t w[][4], bool decrypting)
+{
+  static const int Nr = 10;
+  BitsliceWord q[8], sk[Nr + 1][8];
+
+  Pack(sk[0], key);
+  ExpandKey(sk);
+
+  Pack(q, w);
+
+  if (!decrypting)
+  {
+    AddRoundKey(q, sk[0]);
+    for (int round = 1; round < Nr; round++)
+    {
+      Sbox(q);
+      ShiftRows(q);
+      MixColumns(q);
+      AddRoundKey(q, sk[round]);
+    }
+    Sbox(q);
+    ShiftRows(q);
+    AddRoundKey(q, sk[Nr]);
+  }
+  else
+  {
+    AddRoundKey(q, sk[Nr]);
+    for (int round = Nr - 1; round > 0; round--)
+    {
+      InvShiftRows(q);
+      InvSbox(q);
+      AddRoundKey(q, sk[round]);
+      InvMixColumns(q);
+    }
+    InvShiftRows(q);
+    InvSbox(q);
+    AddRoundKey(q, sk[0]);
+  }
+
+  Unpack(w, q);
+}
+
+static void BitsliceBlocks(const AES128Key *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count, bool decrypting)
+{
+  uint32_t key[AES_BITSLICE_BLOCKS][4];
+  uint32_t w[AES_BITSLICE_BLOCKS][4];
+
+  for (unsigned int group = 0; group < count; group += AES_BITSLICE_BLOCKS)
+  {
+    bool narrow = (count - group <= AES_BITSLICE_BLOCKS / 2);
+    unsigned int width = narrow ? AES_BITSLICE_BLOCKS / 2 : AES_BITSLICE_BLOCKS;
+
+    //Spare slots repeat the last block and are thrown away
+    for (unsigned int i = 0; i < width; i++)
+    {
+      unsigned int n = (group + i < count) ? group + i : count - 1;
+      for (int j = 0; j < 4; j++)
+      {
+        key[i][j] = swap32(keys[n]->enc[j]);
+        w[i][j] = load32le(in[n] + 4 * j);
+      }
+    }
+
+    if (narrow)
+    {
+      BitslicePass<BitsliceNarrow>(key, w, decrypting);
+    }
+    else
+    {
+      BitslicePass<BitsliceWide>(key, w, decrypting);
+    }
+
+    for (unsigned int i = 0; i < AES_BITSLICE_BLOCKS && group + i < count; i++)
+    {
+      for (int j = 0; j < 4; j++)
+      {
+        store32le(out[group + i] + 4 * j, w[i][j]);
+      }
+    }
+  }
+}
+
+void AESBitsliceEncryptBlocks(const AES128Key *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count)
+{
+  BitsliceBlocks(keys, in, out, count, false);
+}
+
+void AESBitsliceDecryptBlocks(const AES128Key *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count)
+{
+  BitsliceBlocks(keys, in, out, count, true);
+}
@@ -0,0 +1,24 @@
+#ifndef _AESBITSLICE_H_
+#define _AESBITSLICE_H_
+
+#include "AES.h"
+
+/*
+ * Bitsliced AES-128 behind the batch functions in AES.h, for CPUs without AES-NI once
+ * AESUseBitslice(true) is set.  Sixteen blocks, each with its own key, go through the
+ * cipher together as boolean operations on wide words, key schedule included, so no
+ * memory access depends on a key or the data.  On x86-64 Linux the kernel is built for
+ * AVX2 and plain SSE2 and picked at load time.
+ */
+
+//Blocks processed per pass
+#define AES_BITSLICE_BLOCKS 16
+
+//Smallest batch worth sending here
+#define AES_BITSLICE_MIN_BLOCKS 8
+
+void AESBitsliceEncryptBlocks(const AES128Key *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+void AESBitsliceDecryptBlocks(const AES128Key *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+#endif
@@ -0,0 +1,124 @@
+#include "AESNI.h"
+
+#ifdef AES_HAVE_NI
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+//Blocks kept in flight at once, enough to cover the latency of aesenc/aesdec
+static const unsigned int lanes = 4;
+
+bool AESNIAvailable()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    return false;
+  }
+
+  //ECX bit 25 is AES-NI, bit 9 is SSSE3 (for the byte swap below)
+  return (ecx & (1 << 25)) && (ecx & (1 << 9));
+}
+
+/*
+ * AESKey stores each round key as big endian column words; the instructions want them as plain bytes.
+ */
+AESNI_TARGET static inline __m128i LoadRoundKey(const uint32_t *words)
+{
+  const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) words), swap);
+}
+
+template <int keyBits, unsigned int n>
+AESNI_TARGET static inline void EncryptLanes(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[])
+{
+  const int Nr = AESKey<keyBits>::Nr;
+  __m128i s[n];
+  unsigned int l;
+
+  for (l = 0; l < n; l++)
+  {
+    s[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in[l]), LoadRoundKey(keys[l]->enc));
+  }
+
+  for (int round = 1; round < Nr; round++)
+  {
+    for (l = 0; l < n; l++)
+    {
+      s[l] = _mm_aesenc_si128(s[l], LoadRoundKey(keys[l]->enc + 4 * round));
+    }
+  }
+
+  for (l = 0; l < n; l++)
+  {
+    _mm_storeu_si128((__m128i *) out[l], _mm_aesenclast_si128(s[l], LoadRoundKey(keys[l]->enc + 4 * Nr)));
+  }
+}
+
+template <int keyBits, unsigned int n>
+AESNI_TARGET static inline void DecryptLanes(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[])
+{
+  const int Nr = AESKey<keyBits>::Nr;
+  __m128i s[n];
+  unsigned int l;
+
+  //AESKey::dec is already the equivalent inverse cipher schedule, which is what aesdec expects
+  for (l = 0; l < n; l++)
+  {
+    s[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in[l]), LoadRoundKey(keys[l]->dec));
+  }
+
+  for (int round = 1; round < Nr; round++)
+  {
+    for (l = 0; l < n; l++)
+    {
+      s[l] = _mm_aesdec_si128(s[l], LoadRoundKey(keys[l]->dec + 4 * round));
+    }
+  }
+
+  for (l = 0; l < n; l++)
+  {
+    _mm_storeu_si128((__m128i *) out[l], _mm_aesdeclast_si128(s[l], LoadRoundKey(keys[l]->dec + 4 * Nr)));
+  }
+}
+
+template <int keyBits>
+AESNI_TARGET void AESNIEncryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count)
+{
+  unsigned int i = 0;
+  for (; i + lanes <= count; i += lanes)
+  {
+    EncryptLanes<keyBits, lanes>(keys + i, in + i, out + i);
+  }
+
+  for (; i < count; i++)
+  {
+    EncryptLanes<keyBits, 1>(keys + i, in + i, out + i);
+  }
+}
+
+template <int keyBits>
+AESNI_TARGET void AESNIDecryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count)
+{
+  unsigned int i = 0;
+  for (; i + lanes <= count; i += lanes)
+  {
+    DecryptLanes<keyBits, lanes>(keys + i, in + i, out + i);
+  }
+
+  for (; i < count; i++)
+  {
+    DecryptLanes<keyBits, 1>(keys + i, in + i, out + i);
+  }
+}
+
+template void AESNIEncryptBlocks<128>(const AESKey<128> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESNIEncryptBlocks<192>(const AESKey<192> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESNIEncryptBlocks<256>(const AESKey<256> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESNIDecryptBlocks<128>(const AESKey<128> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESNIDecryptBlocks<192>(const AESKey<192> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+template void AESNIDecryptBlocks<256>(const AESKey<256> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _AESNI_H_
+#define _AESNI_H_
+
+#include "AES.h"
+
+/*
+ * AES-NI kernels for the batch functions in AES.h.  Only built on x86; AESEncryptBlocks
+ * and AESDecryptBlocks check AESNIAvailable() once and fall back to the table code otherwise.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_HAVE_NI 1
+
+bool AESNIAvailable();
+
+template <int keyBits>
+void AESNIEncryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+template <int keyBits>
+void AESNIDecryptBlocks(const AESKey<keyBits> *const keys[], const unsigned char *const in[], unsigned char *const out[], unsigned int count);
+
+#endif
+
+#endif
@@ -10,12 +10,20 @@ class CRC {
   public:
     CRC(uint8_t wdth, uint64_t poly, uint64_t init);
     
-    void compute(uint8_t* message, int nBytes, uint8_t* destination);
+    void compute(const uint8_t* message, int nBytes, uint8_t* destination) const;
+    
+    //Incremental form: start, feed the message in any number of pieces, then finish (same output as compute)
+    uint64_t start() const;
+    uint64_t update(uint64_t crc, const uint8_t* message, int nBytes) const;
+    uint64_t updateZeros(uint64_t crc, int nBytes) const;
+    void finish(uint64_t crc, uint8_t* destination) const;
     
   private:
     uint8_t width;
     uint64_t polynomial;
     uint64_t initial;
+    uint64_t trim;
+    uint64_t table[256]; //CRC of each possible top byte, so update goes a byte at a time
     
 
 
@@ -0,0 +1,70 @@
+#include "alloccount.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> allocations(0);
+
+static void* countedAlloc(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) {
+	void* p = countedAlloc(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	void* p = countedAlloc(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	free(p);
+}
+
+bool allocationCounting() {
+	return true;
+}
+
+uint64_t allocationCount() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool allocationCounting() {
+	return false;
+}
+
+uint64_t allocationCount() {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _ALLOCCOUNT_H_
+#define _ALLOCCOUNT_H_
+
+#include <stdint.h>
+
+/*
+
+Debug allocation counter.  Built with COUNT_ALLOCATIONS defined, every operator new (plain, array and nothrow) adds
+one to a global count, so a stretch of code can be shown to allocate nothing by reading allocationCount() either side
+of it.  malloc itself isn't hooked, but nothing in the tree calls it directly any more.
+
+Without COUNT_ALLOCATIONS nothing is replaced, the count always reads 0 and allocationCounting() is false.
+
+*/
+
+bool allocationCounting();
+uint64_t allocationCount();
+
+#endif
@@ -0,0 +1,195 @@
+#include "archive.h"
+#include <thread>
+#include <vector>
+
+static inline uint64_t packSpan(uint32_t first, uint32_t end) {
+	return ((uint64_t)end << 32) | first;
+}
+
+/*
+
+Description: Sets up the engine.
+
+Arguments:	_threads - Number of workers, or 0 for one per core
+
+Returns:
+
+*/
+
+ArchiveEngine::ArchiveEngine(unsigned int _threads) : threads(_threads), jobs(NULL), mode(ARCHIVE_DECRYPT), completed(0) {
+	if (!threads) threads = std::thread::hardware_concurrency();
+	if (!threads) threads = 1;
+
+	ranges = new Range[threads];
+}
+
+ArchiveEngine::~ArchiveEngine() {
+	delete[] ranges;
+}
+
+/*
+
+Description: Runs every job and waits for them all.  Each dump is read, switched to the requested state (one that is
+			already there is written out unchanged) and written to its destination.
+
+Arguments:	_jobs - The dumps; done is set on each one that was read and written
+			count - How many
+			_decrypting - Direction
+
+Returns: Number of jobs done
+
+*/
+
+unsigned int ArchiveEngine::run(ArchiveJob _jobs[], unsigned int count, bool _decrypting) {
+	return start(_jobs, count, _decrypting ? ARCHIVE_DECRYPT : ARCHIVE_ENCRYPT);
+}
+
+/*
+
+Description: Validates every checksum of every dump, without writing anything.
+
+Arguments:	_jobs - The dumps; done is set on each one that was read, and checksums to the result
+			count - How many
+
+Returns: Number of jobs read
+
+*/
+
+unsigned int ArchiveEngine::check(ArchiveJob _jobs[], unsigned int count) {
+	return start(_jobs, count, ARCHIVE_CHECK);
+}
+
+unsigned int ArchiveEngine::start(ArchiveJob _jobs[], unsigned int count, ArchiveMode _mode) {
+	jobs = _jobs;
+	mode = _mode;
+	completed = 0;
+
+	//Even split to start with; stealing evens out whatever is uneven about the actual work
+	for (unsigned int worker = 0; worker < threads; worker++) {
+		uint32_t first = (uint64_t)count * worker / threads;
+		uint32_t end = (uint64_t)count * (worker + 1) / threads;
+		ranges[worker].span.store(packSpan(first, end));
+	}
+
+	std::vector<std::thread> pool;
+	for (unsigned int worker = 1; worker < threads; worker++) {
+		pool.push_back(std::thread(&ArchiveEngine::work, this, worker));
+	}
+
+	work(0);
+
+	for (unsigned int i = 0; i < pool.size(); i++) {
+		pool[i].join();
+	}
+
+	return completed;
+}
+
+void ArchiveEngine::work(unsigned int worker) {
+	unsigned int job;
+
+	do {
+		while (take(worker, &job)) {
+			jobs[job].done = process(&jobs[job]);
+			if (jobs[job].done) completed++;
+		}
+	} while (steal(worker));
+}
+
+/*
+
+Description: Takes the next job from the front of a worker's own range.
+
+Arguments:	worker - Whose range
+			job - Where to put the job index
+
+Returns: False if the range is empty
+
+*/
+
+bool ArchiveEngine::take(unsigned int worker, unsigned int* job) {
+	uint64_t span = ranges[worker].span.load();
+
+	while (true) {
+		uint32_t first = span, end = span >> 32;
+		if (first >= end) return false;
+
+		if (ranges[worker].span.compare_exchange_weak(span, packSpan(first + 1, end))) {
+			*job = first;
+			return true;
+		}
+	}
+}
+
+/*
+
+Description: Moves the back half of the fullest other range into this worker's (empty) range.
+
+Arguments:	worker - The thief
+
+Returns: False once there is nothing left anywhere
+
+*/
+
+bool ArchiveEngine::steal(unsigned int worker) {
+	while (true) {
+		unsigned int victim = worker;
+		uint32_t most = 0;
+		uint64_t span = 0;
+
+		for (unsigned int i = 0; i < threads; i++) {
+			if (i == worker) continue;
+
+			uint64_t s = ranges[i].span.load();
+			uint32_t first = s, end = s >> 32;
+			if (end > first && end - first > most) {
+				most = end - first;
+				victim = i;
+				span = s;
+			}
+		}
+
+		if (victim == worker) return false;
+
+		uint32_t first = span, end = span >> 32;
+		uint32_t middle = end - (end - first + 1) / 2;
+
+		//Fails if the owner or another thief got there first; just look again
+		if (ranges[victim].span.compare_exchange_strong(span, packSpan(first, middle))) {
+			ranges[worker].span.store(packSpan(middle, end));
+			return true;
+		}
+	}
+}
+
+/*
+
+Description: Does one dump.  Keys are derived and blocks run through the batch AES functions exactly as for a single
+			figure; there is simply one of these going per core.
+
+Arguments:	job - The dump
+
+Returns: Success boolean
+
+*/
+
+bool ArchiveEngine::process(ArchiveJob* job) {
+	CardImage image;
+	if (!image.load(job->source)) return false;
+
+	Skylander figure(image, NULL);
+	switch (mode) {
+		case ARCHIVE_CHECK:
+			job->checksums = figure.validateChecksums();
+			return true;
+		case ARCHIVE_DECRYPT:
+			figure.decrypt();
+			break;
+		default:
+			figure.encrypt();
+			break;
+	}
+
+	figure.makeFile(job->destination);
+	return true;
+}
@@ -0,0 +1,64 @@
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+
+#include "skylander.h"
+#include "cardimage.h"
+#include <stdint.h>
+#include <atomic>
+
+/*
+
+Decrypts or encrypts a whole archive of Skylander dumps on every core.
+
+Each worker owns a contiguous range of the jobs and takes them from the front.  One that runs dry steals the back half
+of the fullest range left, so a few slow dumps (or a slow disk) never leave cores idle at the end.  A range is a single
+64 bit atomic (first job in the low half, end in the high half), so taking and stealing are both one compare and swap.
+Figures share nothing but the read-only tables, so workers never otherwise wait on each other.
+
+check runs the same way but only reads: every checksum of every dump is validated in one decrypt pass, for a quick
+health check of a whole archive.
+
+*/
+
+struct ArchiveJob {
+	const char* source;
+	const char* destination;
+	bool done;
+	uint16_t checksums;		//After check, as from Skylander::validateChecksums
+};
+
+enum ArchiveMode {
+	ARCHIVE_ENCRYPT,
+	ARCHIVE_DECRYPT,
+	ARCHIVE_CHECK
+};
+
+class ArchiveEngine {
+	public:
+		ArchiveEngine(unsigned int threads = 0);
+		~ArchiveEngine();
+
+		unsigned int run(ArchiveJob jobs[], unsigned int count, bool decrypting);
+		unsigned int check(ArchiveJob jobs[], unsigned int count);
+
+	private:
+		//Padded out to a cache line so workers taking from their own ranges don't slow each other down
+		struct Range {
+			std::atomic<uint64_t> span;
+			uint8_t padding[64 - sizeof(std::atomic<uint64_t>)];
+		};
+
+		unsigned int threads;
+		Range* ranges;
+		ArchiveJob* jobs;
+		ArchiveMode mode;
+		std::atomic<unsigned int> completed;
+
+		void work(unsigned int worker);
+		bool take(unsigned int worker, unsigned int* job);
+		bool steal(unsigned int worker);
+		unsigned int start(ArchiveJob jobs[], unsigned int count, ArchiveMode mode);
+		bool process(ArchiveJob* job);
+};
+
+#endif
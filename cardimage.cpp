@@ -0,0 +1,30 @@
+#include "cardimage.h"
+
+/*
+
+Description: Loads a card dump (0x400 bytes) into the image.  Nothing is marked dirty.
+
+Arguments:	filename - the dump to read
+
+Returns: Success boolean
+
+*/
+
+bool CardImage::load(const char* filename) {
+	dirty = 0;
+	return readFile(filename, &data[0][0], Geometry::bytes);
+}
+
+/*
+
+Description: Writes the image out in the same format as MIFARE_1K::makeFile.
+
+Arguments:	filename - where to write it
+
+Returns:
+
+*/
+
+void CardImage::save(const char* filename) {
+	writeFile(filename, &data[0][0], Geometry::bytes);
+}
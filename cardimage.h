@@ -0,0 +1,75 @@
+#ifndef _CARDIMAGE_H_
+#define _CARDIMAGE_H_
+
+#include "geometry.h"
+#include "misc.h"
+#include <stdint.h>
+#include <memory.h>
+
+/*
+
+A MIFARE 1K card as a plain value: the image plus a dirty bit per block, and nothing else (0x408 bytes).
+There is no hardware pointer and nothing on the heap, so whole archives can be held in an array and copied with memcpy.
+
+The UID, keys and access bits aren't copied out like on MIFARE_1K; they're read and written in place in the trailer blocks.
+
+*/
+
+struct CardImage {
+	typedef Mifare1K Geometry;
+
+	uint8_t data[Geometry::blocks][Geometry::blockSize];
+	uint64_t dirty;
+
+	bool load(const char* filename);
+	void save(const char* filename);
+
+	const uint8_t* block(uint8_t block) const {
+		return data[block];
+	}
+
+	//Marks the block dirty only if it actually changes
+	void setBlock(uint8_t block, const uint8_t in[0x10]) {
+		if (memcmp(data[block], in, 0x10) == 0) return;
+		memcpy(data[block], in, 0x10);
+		dirty |= (1ULL << block);
+	}
+
+	bool isDirty(uint8_t block) const {
+		return (dirty >> block) & 0x01;
+	}
+
+	void clean() {
+		dirty = 0;
+	}
+
+	const uint8_t* uid() const {
+		return data[0];
+	}
+
+	const uint8_t* keyA(uint8_t sector) const {
+		return data[sectorToBlock(sector)];
+	}
+
+	const uint8_t* accessBits(uint8_t sector) const {
+		return data[sectorToBlock(sector)] + 0x06;
+	}
+
+	const uint8_t* keyB(uint8_t sector) const {
+		return data[sectorToBlock(sector)] + 0x0A;
+	}
+
+	void setKeyA(uint8_t sector, const uint8_t key[6]) {
+		memcpy(data[sectorToBlock(sector)], key, 0x06);
+		dirty |= (1ULL << sectorToBlock(sector));
+	}
+
+	void setKeyB(uint8_t sector, const uint8_t key[6]) {
+		memcpy(data[sectorToBlock(sector)] + 0x0A, key, 0x06);
+		dirty |= (1ULL << sectorToBlock(sector));
+	}
+};
+
+static_assert(sizeof(CardImage) == Mifare1K::bytes + 8, "CardImage should only hold the image and the dirty mask");
+
+#endif
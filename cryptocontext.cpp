@@ -0,0 +1,62 @@
+#include "cryptocontext.h"
+
+CryptoContext::CryptoContext() : valid(false) {
+	memset(slot, 0xFF, 0x40);
+}
+
+/*
+
+Description: Checks whether the stored keys were derived from this seed.
+
+Arguments:	seed - Blocks 0x00 and 0x01 of the figure
+
+Returns: True if the keys can be used
+
+*/
+
+bool CryptoContext::matches(const uint8_t _seed[0x20]) {
+	return valid && (memcmp(seed, _seed, 0x20) == 0);
+}
+
+/*
+
+Description: Expands and keeps a set of block keys.
+
+Arguments:	_seed - Blocks 0x00 and 0x01 the keys were derived from
+			blocks - Which block each key is for
+			keys - The MD5 derived AES keys
+			count - How many
+
+Returns:
+
+*/
+
+void CryptoContext::store(const uint8_t _seed[0x20], const uint8_t blocks[], const uint8_t keys[][0x10], uint8_t count) {
+	memcpy(seed, _seed, 0x20);
+	memset(slot, 0xFF, 0x40);
+	
+	for (uint8_t i = 0; i < count; i++) {
+		slot[blocks[i]] = i;
+		expanded[i].expand(keys[i]);
+	}
+	
+	valid = true;
+}
+
+void CryptoContext::invalidate() {
+	valid = false;
+}
+
+/*
+
+Description: Gets the expanded key for a block.  Only call this after matches() or store().
+
+Arguments:	block - Which block
+
+Returns: The key
+
+*/
+
+const AES128Key& CryptoContext::key(uint8_t block) {
+	return expanded[slot[block]];
+}
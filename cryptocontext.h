@@ -0,0 +1,33 @@
+#ifndef _CRYPTOCONTEXT_H_
+#define _CRYPTOCONTEXT_H_
+
+#include "AES.h"
+#include <stdint.h>
+#include <memory.h>
+
+/*
+
+Keeps the expanded AES keys for a figure's encrypted blocks so they're only derived once.
+Every key comes from the MD5 of blocks 0x00-0x01 (plus the block number), so the keys are valid exactly as long as
+those 0x20 bytes are unchanged; matches() compares them each time, so edits anywhere else never cost a rederivation.
+
+*/
+
+class CryptoContext {
+	public:
+		CryptoContext();
+		
+		bool matches(const uint8_t seed[0x20]);
+		void store(const uint8_t seed[0x20], const uint8_t blocks[], const uint8_t keys[][0x10], uint8_t count);
+		void invalidate();
+		
+		const AES128Key& key(uint8_t block);
+		
+	private:
+		bool valid;
+		uint8_t seed[0x20];
+		uint8_t slot[0x40];
+		AES128Key expanded[0x40];
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _GEOMETRY_H_
+#define _GEOMETRY_H_
+
+#include <stdint.h>
+
+/*
+
+Compile time layout of a MIFARE Classic 1K card: 16 sectors of 4 blocks, the last block of each being the sector
+trailer.  Everything here is constexpr, so block loops fold down to constants.
+
+Only the 1K is supported.  The card classes, PN532 reads and Skylander code all assume 0x40 blocks indexed by a uint8_t,
+so the Mini and 4K layouts (4K has 0x100 blocks and larger sectors past block 0x80) would need the whole Classic engine
+reworked, not just another layout here.
+
+*/
+
+struct Mifare1K {
+	static constexpr uint8_t sectorBlocks = 4;
+	static constexpr uint8_t blockSize = 0x10;
+
+	static constexpr uint8_t sectors = 16;
+	static constexpr uint16_t blocks = sectors * sectorBlocks;
+	static constexpr uint16_t bytes = blocks * blockSize;
+
+	static constexpr uint8_t firstBlock(uint8_t sector) {
+		return sector * sectorBlocks;
+	}
+
+	static constexpr uint8_t trailerBlock(uint8_t sector) {
+		return firstBlock(sector) + sectorBlocks - 1;
+	}
+
+	static constexpr uint8_t blockToSector(uint8_t block) {
+		return block / sectorBlocks;
+	}
+
+	static constexpr bool isTrailerBlock(uint8_t block) {
+		return (block % sectorBlocks == sectorBlocks - 1);
+	}
+
+	static constexpr bool isFirstBlock(uint8_t block) {
+		return (block % sectorBlocks == 0);
+	}
+};
+
+static_assert(Mifare1K::bytes == 0x400, "MIFARE 1K is 1KiB");
+static_assert(Mifare1K::trailerBlock(15) == 0x3F, "Last 1K trailer is block 0x3F");
+
+/*
+
+The block/sector helpers used throughout.
+Note sectorToBlock gives the sector trailer, which is the block that gets authenticated.
+
+*/
+
+template <class Geometry = Mifare1K>
+constexpr bool isTrailerBlock(uint8_t block) {
+	return Geometry::isTrailerBlock(block);
+}
+
+template <class Geometry = Mifare1K>
+constexpr bool isFirstBlock(uint8_t block) {
+	return Geometry::isFirstBlock(block);
+}
+
+template <class Geometry = Mifare1K>
+constexpr uint8_t blockToSector(uint8_t block) {
+	return Geometry::blockToSector(block);
+}
+
+template <class Geometry = Mifare1K>
+constexpr uint8_t sectorToBlock(uint8_t sector) {
+	return Geometry::trailerBlock(sector);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "imagecache.h"
+
+ImageCache::ImageCache(const char* _directory) {
+	snprintf(directory, sizeof(directory), "%s", _directory);
+	path[0] = 0x00;
+}
+
+/*
+
+Description: Gets the cached image of a card.
+
+Arguments:	uid - UID of the card
+			image - Destination for the image
+
+Returns: True if the card was in the cache
+
+*/
+
+bool ImageCache::load(uint8_t uid[4], uint8_t image[0x40][0x10]) {
+	makePath(uid);
+	
+	return readFile(path, &image[0][0], 0x400);
+}
+
+/*
+
+Description: Saves the image of a card, replacing any older one.
+
+Arguments:	uid - UID of the card
+			image - The card's image
+
+Returns: 
+
+*/
+
+void ImageCache::store(uint8_t uid[4], uint8_t image[0x40][0x10]) {
+	makePath(uid);
+	
+	writeFile(path, &image[0][0], 0x400);
+}
+
+void ImageCache::makePath(uint8_t uid[4]) {
+	snprintf(path, sizeof(path), "%s/%02X%02X%02X%02X.img", directory, uid[0], uid[1], uid[2], uid[3]);
+}
@@ -0,0 +1,29 @@
+#ifndef _IMAGECACHE_H_
+#define _IMAGECACHE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "misc.h"
+
+/*
+
+Keeps the last known image of each card, one file per UID in the same format as a dump (0x400 bytes).
+MIFARE_1K::read checks a few fingerprint blocks against it and skips the full read when they match.
+
+*/
+
+class ImageCache {
+	public:
+		ImageCache(const char* _directory);
+		
+		bool load(uint8_t uid[4], uint8_t image[0x40][0x10]);
+		void store(uint8_t uid[4], uint8_t image[0x40][0x10]);
+		
+	private:
+		char directory[0x100];
+		char path[0x120];
+		
+		void makePath(uint8_t uid[4]);
+};
+
+#endif
@@ -130,6 +130,70 @@ bool interface::receiveI2C(uint8_t i2caddr, uint8_t* data, uint8_t len) {
 
 
 
+/*
+
+Description: Gets the Arduino back to the start of a packet after it has stopped responding (e.g. it is waiting on bytes that
+			were lost).  TEST bytes are sent one at a time, which either complete the stuck packet or are answered directly.
+
+Arguments:	
+
+			The whole thing is bounded by RESYNC_MS rather than by a byte count, so a dead link gives up quickly.
+
+Returns: Success boolean - true once the Arduino answers
+
+*/
+
+bool interface::resync() {
+	uint8_t response;
+	bool answered = false;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RESYNC_MS);
+	
+	tcflush(ID, TCIOFLUSH);
+	
+	for (uint8_t i = 0; i < 0x48 && !answered; i++) {
+		int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (remaining <= 0) break;
+		
+		uint8_t test = TEST;
+		write(ID, &test, 1);
+		
+		//A few ms per byte is plenty at 115200 baud; the deadline caps the total
+		struct pollfd ready = {ID, POLLIN, 0};
+		if (poll(&ready, 1, remaining < 5 ? remaining : 5) == 1 && read(ID, &response, 1) == 1) {
+			answered = (response == ACK || response == NACK);
+		}
+	}
+	
+	//Throw away anything else it had queued up
+	usleep(10000);
+	tcflush(ID, TCIOFLUSH);
+	
+	if (debug) {
+		printf("\t\tResync %s.\n", answered ? "succeeded" : "failed");
+	}
+	
+	return answered;
+}
+
+/*
+
+Description: Sets how long reads wait for the first byte.
+
+Arguments:	deciseconds - The timeout, in tenths of a second
+
+Returns: 
+
+*/
+
+void interface::setTimeout(uint8_t deciseconds) {
+	struct termios tty;
+	
+	if (tcgetattr(ID, &tty) != 0) return;
+	
+	tty.c_cc[VTIME] = deciseconds;
+	tcsetattr(ID, TCSANOW, &tty);
+}
+
 void interface::toggleDebug() {
 	debug = !debug;
 }
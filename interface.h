@@ -5,6 +5,8 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
+#include <chrono>
 #include "misc.h"
 #include <stdint.h>
 
@@ -14,6 +16,9 @@
 #define NACK 0x55
 #define TEST 0xff
 
+//Longest resync() may take, in ms, however many bytes that allows
+#define RESYNC_MS 250
+
 /*
 
 I2C protocol: 
@@ -48,6 +53,8 @@ class interface {
 		bool receiveI2C(uint8_t i2caddr, uint8_t* data, uint8_t len);
 		
 		bool sendAck(uint8_t* data, int len);
+		
+		bool resync();
 
 		
 	private:
@@ -63,6 +70,7 @@ class interface {
 		int receive(uint8_t* destination, int len);
 		
 		int convertBaud(int baud);
+		void setTimeout(uint8_t deciseconds);
 		
 		bool sendKey(uint8_t key[6]);
 };
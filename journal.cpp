@@ -0,0 +1,146 @@
+#include "journal.h"
+
+const char journalMagic[4] = {'P', 'M', 'J', '1'};
+
+WriteJournal::WriteJournal(const char* _directory) : file(-1), pending(0) {
+	snprintf(directory, sizeof(directory), "%s", _directory);
+	path[0] = 0x00;
+}
+
+WriteJournal::~WriteJournal() {
+	if (file >= 0) close(file);
+}
+
+/*
+
+Description: Records the target image before any blocks are written.  If a journal already exists for this UID with the
+			same target, the blocks it says have landed are cleared from altered, so the write carries on where it left off.
+
+Arguments:	uid - UID of the card
+			image - The full image being written
+			altered - Which blocks will be written (may be cleared by this function)
+
+Returns: Success boolean
+
+*/
+
+bool WriteJournal::begin(uint8_t uid[4], uint8_t image[0x40][0x10], bool altered[0x40]) {
+	uint8_t previous[0x40][0x10];
+	uint64_t previousPending;
+	
+	bool resuming = load(uid, previous, &previousPending) && (memcmp(previous, image, 0x400) == 0);
+	
+	pending = 0;
+	for (uint8_t block = 0; block < 0x40; block++) {
+		if (resuming && !(previousPending & ((uint64_t)1 << block))) altered[block] = false;
+		if (altered[block]) pending |= ((uint64_t)1 << block);
+	}
+	
+	if (resuming) {
+		printf("Resuming an interrupted write.\n");
+	}
+	
+	if (file >= 0) close(file);
+	file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) return false;
+	
+	uint8_t header[0x10];
+	memcpy(header, journalMagic, 4);
+	memcpy(header + 0x04, uid, 4);
+	memset(header + 0x08, 0x00, 0x08);
+	
+	if (write(file, header, 0x10) != 0x10 || write(file, image, 0x400) != 0x400) return false;
+	
+	return writeMask();
+}
+
+/*
+
+Description: Marks a block as having landed on the card.
+
+Arguments:	block - The block that was written
+
+Returns: Success boolean
+
+*/
+
+bool WriteJournal::complete(uint8_t block) {
+	if (file < 0) return false;
+	
+	pending &= ~((uint64_t)1 << block);
+	return writeMask();
+}
+
+/*
+
+Description: Removes the journal once the write has finished.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void WriteJournal::finish() {
+	if (file < 0) return;
+	
+	close(file);
+	file = -1;
+	remove(path);
+}
+
+/*
+
+Description: Loads an unfinished write for a card, so it can be completed.
+
+Arguments:	uid - UID of the card
+			image - Destination for the target image
+			altered - Set for each block still to be written
+
+Returns: True if there was an unfinished write
+
+*/
+
+bool WriteJournal::resume(uint8_t uid[4], uint8_t image[0x40][0x10], bool altered[0x40]) {
+	uint64_t mask;
+	
+	if (!load(uid, image, &mask)) return false;
+	
+	for (uint8_t block = 0; block < 0x40; block++) {
+		altered[block] = (mask >> block) & 0x01;
+	}
+	
+	return true;
+}
+
+void WriteJournal::makePath(uint8_t uid[4]) {
+	snprintf(path, sizeof(path), "%s/%02X%02X%02X%02X.journal", directory, uid[0], uid[1], uid[2], uid[3]);
+}
+
+bool WriteJournal::load(uint8_t uid[4], uint8_t image[0x40][0x10], uint64_t* mask) {
+	uint8_t header[0x10];
+	
+	makePath(uid);
+	
+	int in = open(path, O_RDONLY);
+	if (in < 0) return false;
+	
+	bool complete = (read(in, header, 0x10) == 0x10) && (read(in, image, 0x400) == 0x400);
+	close(in);
+	if (!complete) return false;
+	
+	if (memcmp(header, journalMagic, 4) || memcmp(header + 0x04, uid, 4)) return false;
+	
+	*mask = bytesToInt(header + 0x08, 0x08);
+	return true;
+}
+
+bool WriteJournal::writeMask() {
+	uint8_t mask[0x08];
+	
+	for (uint8_t i = 0; i < 0x08; i++) {
+		mask[i] = (pending >> (8 * i)) & 0xFF;
+	}
+	
+	return (pwrite(file, mask, 0x08, 0x08) == 0x08);
+}
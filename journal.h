@@ -0,0 +1,45 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory.h>
+#include "misc.h"
+
+/*
+
+Write-ahead journal for MIFARE_1K::updateData.  One small file per UID holds the target image and a mask of
+blocks that have not landed yet:
+
+	0x000	"PMJ1"
+	0x004	UID
+	0x008	Pending block mask (little endian, bit n is block n)
+	0x010	Target image (0x400 bytes)
+
+The file is removed once every block has been written.
+
+*/
+
+class WriteJournal {
+	public:
+		WriteJournal(const char* _directory);
+		~WriteJournal();
+		
+		bool begin(uint8_t uid[4], uint8_t image[0x40][0x10], bool altered[0x40]);
+		bool complete(uint8_t block);
+		void finish();
+		
+		bool resume(uint8_t uid[4], uint8_t image[0x40][0x10], bool altered[0x40]);
+		
+	private:
+		char directory[0x100];
+		char path[0x120];
+		int file;				//Descriptor, -1 when closed; streams would allocate a buffer on every begin
+		uint64_t pending;
+		
+		void makePath(uint8_t uid[4]);
+		bool load(uint8_t uid[4], uint8_t image[0x40][0x10], uint64_t* mask);
+		bool writeMask();
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "keydict.h"
+#include "misc.h"
+
+const char dictionaryMagic[4] = {'P', 'M', 'K', '2'};
+//Before attempts were kept; loaded as if each key had only been tried when it worked
+const char dictionaryMagicV1[4] = {'P', 'M', 'K', 'D'};
+
+//Well known keys, for a dictionary with no history
+const uint8_t defaultKeys[][6] = {
+									{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF},
+									{0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5},
+									{0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7},
+									{0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+									{0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5},
+									{0x4D, 0x3A, 0x99, 0xC3, 0x51, 0xDD},
+									{0x1A, 0x98, 0x2C, 0x7E, 0x45, 0x9A},
+									{0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF},
+									{0x71, 0x4C, 0x5C, 0x88, 0x6E, 0x97},
+									{0x58, 0x7E, 0xE5, 0xF9, 0x35, 0x0F},
+									{0xA0, 0x47, 0x8C, 0xC3, 0x90, 0x91},
+									{0x53, 0x3C, 0xB6, 0xC7, 0x23, 0xF6},
+									{0x8F, 0xD0, 0xA4, 0xF2, 0x56, 0xE9},
+									{0x4B, 0x0B, 0x20, 0x10, 0x7C, 0xCB}
+								};
+
+//Hit rate with a prior of one hit in two attempts, compared without dividing
+static bool betterRate(const DictionaryKey& a, const DictionaryKey& b) {
+	uint64_t rateA = (uint64_t)(a.hits + 1) * (b.attempts + 2);
+	uint64_t rateB = (uint64_t)(b.hits + 1) * (a.attempts + 2);
+	
+	if (rateA != rateB) return rateA > rateB;
+	return a.hits > b.hits;
+}
+
+KeyDictionary::KeyDictionary(const char* _filename) : sorted(false) {
+	snprintf(filename, sizeof(filename), "%s", _filename);
+	
+	if (!load()) addDefaults();
+}
+
+/*
+
+Description: Adds a key to the dictionary, if it isn't already there.
+
+Arguments:	key - The key to add
+
+Returns: 
+
+*/
+
+void KeyDictionary::addKey(uint8_t key[6]) {
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (memcmp(keys[i].key, key, 6) == 0) return;
+	}
+	
+	DictionaryKey newKey;
+	memcpy(newKey.key, key, 6);
+	newKey.hits = 0;
+	newKey.attempts = 0;
+	keys.push_back(newKey);
+}
+
+/*
+
+Description: Gives the keys to try for a sector, best first: the key that worked for this card before (if any), then
+			every other key by hit rate.
+
+Arguments:	uid - UID of the card
+			sector - The sector to authenticate
+			destination - Destination for the keys
+			max - Size of destination
+
+Returns: Number of keys
+
+*/
+
+uint8_t KeyDictionary::candidates(uint8_t uid[4], uint8_t sector, uint8_t destination[][6], uint8_t max) {
+	uint8_t count = 0;
+	uint8_t* known = NULL;
+	
+	if (!sorted) {
+		std::stable_sort(keys.begin(), keys.end(), betterRate);
+		sorted = true;
+	}
+	
+	std::map<uint32_t, CardKeys>::iterator card = cards.find(cardKey(uid));
+	if (card != cards.end() && ((card->second.known >> sector) & 0x01)) {
+		known = card->second.keys[sector];
+		memcpy(destination[count++], known, 6);
+	}
+	
+	for (size_t i = 0; i < keys.size() && count < max; i++) {
+		if (known && memcmp(keys[i].key, known, 6) == 0) continue;
+		memcpy(destination[count++], keys[i].key, 6);
+	}
+	
+	return count;
+}
+
+/*
+
+Description: Records that a key worked.
+
+Arguments:	uid - UID of the card
+			sector - The sector it worked for
+			key - The key
+
+Returns: 
+
+*/
+
+void KeyDictionary::hit(uint8_t uid[4], uint8_t sector, uint8_t key[6]) {
+	addKey(key);
+	
+	DictionaryKey* entry = find(key);
+	entry->hits++;
+	entry->attempts++;
+	sorted = false;
+	
+	CardKeys& card = cards[cardKey(uid)];
+	card.known |= (1 << sector);
+	memcpy(card.keys[sector], key, 6);
+}
+
+/*
+
+Description: Records that a key was tried and didn't work.
+
+Arguments:	key - The key
+
+Returns: 
+
+*/
+
+void KeyDictionary::miss(uint8_t key[6]) {
+	DictionaryKey* entry = find(key);
+	if (entry == NULL) return;
+	
+	entry->attempts++;
+	sorted = false;
+}
+
+/*
+
+Description: Writes the dictionary and per-card keys to its file.
+
+Arguments:	
+
+Returns: Success boolean
+
+*/
+
+bool KeyDictionary::save() {
+	uint8_t buffer[0x70];
+	
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) return false;
+	
+	file.write(dictionaryMagic, 4);
+	
+	littleEndian(keys.size(), 4, buffer);
+	file.write((char*)buffer, 4);
+	
+	for (size_t i = 0; i < keys.size(); i++) {
+		memcpy(buffer, keys[i].key, 6);
+		littleEndian(keys[i].hits, 4, buffer + 6);
+		littleEndian(keys[i].attempts, 4, buffer + 10);
+		file.write((char*)buffer, 14);
+	}
+	
+	littleEndian(cards.size(), 4, buffer);
+	file.write((char*)buffer, 4);
+	
+	for (std::map<uint32_t, CardKeys>::iterator i = cards.begin(); i != cards.end(); i++) {
+		littleEndian(i->first, 4, buffer);
+		littleEndian(i->second.known, 2, buffer + 4);
+		memcpy(buffer + 6, i->second.keys, 0x60);
+		file.write((char*)buffer, 0x66);
+	}
+	
+	file.close();
+	return true;
+}
+
+uint32_t KeyDictionary::cardKey(uint8_t uid[4]) {
+	return bytesToInt(uid, 4);
+}
+
+DictionaryKey* KeyDictionary::find(uint8_t key[6]) {
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (memcmp(keys[i].key, key, 6) == 0) return &keys[i];
+	}
+	
+	return NULL;
+}
+
+void KeyDictionary::addDefaults() {
+	for (size_t i = 0; i < sizeof(defaultKeys) / 6; i++) {
+		addKey((uint8_t*)defaultKeys[i]);
+	}
+}
+
+bool KeyDictionary::load() {
+	uint8_t buffer[0x70];
+	
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file.is_open()) return false;
+	
+	if (!file.read((char*)buffer, 8)) return false;
+	
+	bool withAttempts = (memcmp(buffer, dictionaryMagic, 4) == 0);
+	if (!withAttempts && memcmp(buffer, dictionaryMagicV1, 4)) return false;
+	
+	uint8_t recordSize = withAttempts ? 14 : 10;
+	
+	uint32_t nKeys = bytesToInt(buffer + 4, 4);
+	for (uint32_t i = 0; i < nKeys; i++) {
+		if (!file.read((char*)buffer, recordSize)) return false;
+		
+		DictionaryKey key;
+		memcpy(key.key, buffer, 6);
+		key.hits = bytesToInt(buffer + 6, 4);
+		key.attempts = withAttempts ? bytesToInt(buffer + 10, 4) : key.hits;
+		keys.push_back(key);
+	}
+	
+	if (!file.read((char*)buffer, 4)) return false;
+	
+	uint32_t nCards = bytesToInt(buffer, 4);
+	for (uint32_t i = 0; i < nCards; i++) {
+		if (!file.read((char*)buffer, 0x66)) return false;
+		
+		CardKeys& card = cards[bytesToInt(buffer, 4)];
+		card.known = bytesToInt(buffer + 4, 2);
+		memcpy(card.keys, buffer + 6, 0x60);
+	}
+	
+	return true;
+}
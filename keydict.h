@@ -0,0 +1,63 @@
+#ifndef _KEYDICT_H_
+#define _KEYDICT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory.h>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+/*
+
+Candidate key A values for reading MIFARE 1K cards whose keys aren't known in advance.  Keys are tried in order of
+their hit rate (how often they worked when tried), after any key that already worked for the same card and sector.
+The rate starts from one hit in two tries, so an untried key ranks with a key that works half the time, and a few
+lucky or unlucky tries don't swing a key to the top or bottom.
+
+File format (all little endian):
+
+	"PMK2"
+	Number of keys (4 bytes), then for each: key (6 bytes), hits (4 bytes), attempts (4 bytes)
+	Number of UIDs (4 bytes), then for each: UID (4 bytes), known sector mask (2 bytes), 16 keys (6 bytes each)
+
+Files starting "PMKD" have no attempts in their key records and still load, with attempts taken as equal to hits.
+
+*/
+
+struct DictionaryKey {
+	uint8_t key[6];
+	uint32_t hits;
+	uint32_t attempts;
+};
+
+struct CardKeys {
+	uint16_t known;
+	uint8_t keys[0x10][0x06];
+};
+
+class KeyDictionary {
+	public:
+		KeyDictionary(const char* _filename);
+		
+		void addKey(uint8_t key[6]);
+		uint8_t candidates(uint8_t uid[4], uint8_t sector, uint8_t destination[][6], uint8_t max);
+		void hit(uint8_t uid[4], uint8_t sector, uint8_t key[6]);
+		void miss(uint8_t key[6]);
+		
+		bool save();
+		
+	private:
+		char filename[0x100];
+		std::vector<DictionaryKey> keys;
+		std::map<uint32_t, CardKeys> cards;
+		bool sorted;
+		
+		uint32_t cardKey(uint8_t uid[4]);
+		DictionaryKey* find(uint8_t key[6]);
+		void addDefaults();
+		bool load();
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "magic.h"
+
+MagicCache::MagicCache(const char* _filename) {
+	uint8_t record[5];
+	
+	snprintf(filename, sizeof(filename), "%s", _filename);
+	
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	
+	while (file.read((char*)record, 5)) {
+		types[key(record)] = record[4];
+	}
+}
+
+/*
+
+Description: Looks up a card.
+
+Arguments:	uid - UID of the card
+
+Returns: The cached type, or MAGIC_UNKNOWN if the card hasn't been probed
+
+*/
+
+MagicType MagicCache::lookup(uint8_t uid[4]) {
+	std::map<uint32_t, uint8_t>::iterator i = types.find(key(uid));
+	
+	if (i == types.end()) return MAGIC_UNKNOWN;
+	
+	return (MagicType)i->second;
+}
+
+/*
+
+Description: Saves a probe result.
+
+Arguments:	uid - UID of the card
+			type - What the card is
+
+Returns: 
+
+*/
+
+void MagicCache::store(uint8_t uid[4], MagicType type) {
+	uint8_t record[5] = {uid[0], uid[1], uid[2], uid[3], (uint8_t)type};
+	
+	if (type != MAGIC_NONE && type != MAGIC_GEN1A && type != MAGIC_GEN2) return;
+	if (lookup(uid) == type) return;
+	
+	types[key(uid)] = type;
+	
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::app);
+	file.write((char*)record, 5);
+	file.close();
+}
+
+uint32_t MagicCache::key(uint8_t uid[4]) {
+	return ((uint32_t)uid[0] << 24) | ((uint32_t)uid[1] << 16) | ((uint32_t)uid[2] << 8) | uid[3];
+}
+
+/*
+
+Description: Gets a printable name for a card type.
+
+Arguments:	type - The card type
+
+Returns: The name
+
+*/
+
+const char* magicTypeName(MagicType type) {
+	switch (type) {
+		case MAGIC_NONE:
+			return "genuine";
+		case MAGIC_GEN1A:
+			return "gen1a";
+		case MAGIC_GEN2:
+			return "gen2/CUID";
+		case MAGIC_ONE_TIME:
+			return "FUID/UFUID";
+		case MAGIC_NO_BACKDOOR:
+			return "gen2, FUID or genuine (no backdoor)";
+		default:
+			return "unknown";
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef _MAGIC_H_
+#define _MAGIC_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <fstream>
+
+enum MagicType {
+	MAGIC_UNKNOWN,
+	MAGIC_NONE,		//Genuine card, block zero is read only
+	MAGIC_GEN1A,	//Backdoor (0x40/0x43), everything writable without authentication
+	MAGIC_GEN2,		//CUID, block zero can be written directly after authenticating
+	MAGIC_ONE_TIME,	//FUID/UFUID, block zero can only be written once
+	MAGIC_NO_BACKDOOR	//No backdoor; gen2, FUID and genuine cards only differ in whether they accept a block zero write
+};
+
+const char* magicTypeName(MagicType type);
+
+/*
+
+Remembers what kind of card each UID is, so the probe only has to run once per card.  Results are kept in a file
+of 5 byte records (UID, type); later records for a UID replace earlier ones.  Only types that are known for certain
+and can't change (gen1a, gen2 and genuine) are kept; a one-time card stops being writable after its write.
+
+*/
+
+class MagicCache {
+	public:
+		MagicCache(const char* _filename);
+		
+		MagicType lookup(uint8_t uid[4]);
+		void store(uint8_t uid[4], MagicType type);
+		
+	private:
+		char filename[0x100];
+		std::map<uint32_t, uint8_t> types;
+		
+		uint32_t key(uint8_t uid[4]);
+};
+
+#endif
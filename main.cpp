@@ -5,15 +5,76 @@
 #include "mifare.h"
 #include "misc.h"
 #include "pn532.h"
+#include "presence.h"
+#include "rftuner.h"
+#include "journal.h"
+#include "magic.h"
+#include "imagecache.h"
+#include "keydict.h"
 #include "skylander.h"
 #include "toynames.h"
+#include "archive.h"
+#include "alloccount.h"
 
 #include <stdio.h>
 #include <stdint.h>
 #include <getopt.h>
+#include <stdlib.h>
+#include <chrono>
 
 using namespace std; 
 
+//Allocations and time per step for the -Z benchmark.  begin() starts a cycle, and each mark() ends the current step.
+struct BenchmarkPass {
+	const char* const* names;
+	uint8_t nSteps;
+	uint8_t step;
+	bool counting;
+	uint64_t allocations[8];
+	double micros[8];
+	uint64_t lastCount;
+	std::chrono::steady_clock::time_point lastTime;
+	
+	BenchmarkPass(const char* const* _names, uint8_t _nSteps) : names(_names), nSteps(_nSteps), step(0), counting(false) {
+		memset(allocations, 0x00, sizeof(allocations));
+		memset(micros, 0x00, sizeof(micros));
+	}
+	
+	//Warm up cycles (counting false) are run but not recorded
+	void begin(bool _counting) {
+		step = 0;
+		counting = _counting;
+		lastCount = allocationCount();
+		lastTime = std::chrono::steady_clock::now();
+	}
+	
+	void mark() {
+		uint64_t count = allocationCount();
+		std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+		
+		if (counting && step < nSteps) {
+			allocations[step] += count - lastCount;
+			micros[step] += std::chrono::duration<double, std::micro>(time - lastTime).count();
+		}
+		
+		step++;
+		lastCount = count;
+		lastTime = time;
+	}
+	
+	//Prints the averages and gives the total allocations
+	uint64_t report(unsigned int cycles) {
+		uint64_t total = 0;
+		
+		for (uint8_t i = 0; i < nSteps; i++) {
+			printf("%-10s %10.2f us %6llu allocations\n", names[i], cycles ? micros[i] / cycles : 0.0, (unsigned long long)allocations[i]);
+			total += allocations[i];
+		}
+		
+		return total;
+	}
+};
+
 int main(int argc, char** argv) {
 	interface port("/dev/cu.usbserial-AR0KL3OY");
 	port.begin(115200);
@@ -39,15 +100,32 @@ int main(int argc, char** argv) {
 		{"reset", no_argument, 0, 'R'},
 		{"compare", required_argument, 0, 'C'},
 		{"XP", optional_argument, 0, 'X'},
+		{"watch", no_argument, 0, 'W'},
+		{"adaptive", no_argument, 0, 'a'},
+		{"budget", required_argument, 0, 'b'},
+		{"verify", no_argument, 0, 'V'},
+		{"gen1a", no_argument, 0, 'g'},
+		{"write-test", no_argument, 0, 'M'},
+		{"dictionary", required_argument, 0, 'k'},
+		{"bitslice", no_argument, 0, 'B'},
+		{"archive", required_argument, 0, 'A'},
+		{"health", required_argument, 0, 'H'},
+		{"allocations", required_argument, 0, 'Z'},
+		{"resume", no_argument, 0, 'J'},
 		{0,0,0,0}
 		};
 	
 	char* filename;
 	char* filename2;
-	const char* legal_flags = "isrwvf:mptcRC:dDX";
+	char* dictionaryFile = NULL;
+	char* archiveList = NULL;
+	char* healthList = NULL;
+	char* benchmarkFile = NULL;
+	const char* legal_flags = "isrwvf:mptcRC:dDXWab:Vgk:BA:H:Z:MJ";
 	int optindex, opt;
-	bool setup, read, write, file, view, magic, info, prepare, test, clone, reset, compare, XP, debugPort, debugPN532;
-	setup = read = write = file = view = magic = info = prepare = test = clone = reset = compare = XP = debugPort = debugPN532 = false;
+	uint32_t budget = 0;
+	bool setup, read, write, file, view, magic, info, prepare, test, clone, reset, compare, XP, watch, adaptive, verify, gen1a, writeTest, dictionary, archive, health, benchmark, resume, debugPort, debugPN532;
+	setup = read = write = file = view = magic = info = prepare = test = clone = reset = compare = XP = watch = adaptive = verify = gen1a = writeTest = dictionary = archive = health = benchmark = resume = debugPort = debugPN532 = false;
 
 	while ((opt = getopt_long(argc, argv, legal_flags, longoptions, &optindex)) != -1) {
 		
@@ -114,6 +192,58 @@ int main(int argc, char** argv) {
 				XP = true;
 				break;
 				
+			case 'W':
+				watch = true;
+				break;
+				
+			case 'a':
+				adaptive = true;
+				break;
+				
+			case 'b':
+				budget = atoi(optarg);
+				break;
+				
+			case 'V':
+				verify = true;
+				break;
+				
+			case 'g':
+				gen1a = true;
+				break;
+				
+			case 'M':
+				writeTest = true;
+				break;
+				
+			case 'k':
+				dictionary = true;
+				dictionaryFile = optarg;
+				break;
+				
+			case 'B':
+				AESUseBitslice(true);
+				break;
+				
+			case 'A':
+				archive = true;
+				archiveList = optarg;
+				break;
+				
+			case 'H':
+				health = true;
+				healthList = optarg;
+				break;
+				
+			case 'Z':
+				benchmark = true;
+				benchmarkFile = optarg;
+				break;
+				
+			case 'J':
+				resume = true;
+				break;
+				
 			case 0:
 				break;
 				
@@ -125,6 +255,19 @@ int main(int argc, char** argv) {
 						"\t-e: Decrypt data when saving or printing.\n"
 						"\t-r: Read a Skylander from the PN532 and print its contents.\n"
 						"\t-c: Update the checksums on a skylander.\n"
+						"\t-W: Watch the portal and report figures being placed and removed.\n"
+						"\t-a: Tune the PN532 RF timeouts and retries while reading and writing.\n"
+						"\t-b <ms>: Only write if it can finish within this many ms, otherwise leave the old save.\n"
+						"\t-J: Finish a write to the figure on the portal that was interrupted, from its journal.\n"
+						"\t-V: Read back each block after writing it, and write it again if it didn't stick.\n"
+						"\t-g: The target is a gen1a magic card; write everything through its backdoor.\n"
+						"\t-M: With -m or -c, tell gen2 cards from genuine ones by writing block zero back to itself (locks an unlocked FUID).\n"
+						"\t-k <file>: Read any MIFARE 1K card by trying the keys in this dictionary, learning which ones work.\n"
+						"\t-B: Without AES-NI, use constant time bitsliced AES instead of lookup tables.\n"
+						"\t-A <list>: Encrypt (or with --decrypt, decrypt) every dump in the list, one \"source destination\" per line, on all cores.\n"
+						"\t-Z <file>: Run the offline read, decrypt, edit, checksum, encrypt, write cycle on this dump and fail if it allocates\n"
+						"\t\t(needs a build with COUNT_ALLOCATIONS).  With -s, also runs it against the figure on the reader.\n"
+						"\t-H <list>: Check every checksum of every dump in the list, one per line, on all cores.\n"
 						"\n"
 						"\t-d: Enable debugging for the PN532.\n"
 						"\t-D: Enable debugging for the Serial to I2C interface."
@@ -147,8 +290,37 @@ int main(int argc, char** argv) {
 		printf("Setup Complete.\n");
 	}
 	
+	RFTuner tuner(&pn532);
+	if (adaptive) {
+		tuner.begin();
+	}
+	
+	ImageCache imageCache(".");
+	
+	//Before anything else touches the figure, so an interrupted write is finished first
+	if (resume) {
+		Skylander skylander(&pn532);
+		PresenceMonitor presence(&pn532);
+		if (presence.poll() == TAG_ARRIVED) skylander.setPresence(&presence);
+		if (adaptive) skylander.setTuner(&tuner);
+		WriteJournal journal(".");
+		skylander.setJournal(&journal);
+		skylander.setImageCache(&imageCache);
+		skylander.setVerify(verify);
+		
+		if (!skylander.resumeJournal()) {
+			printf("No unfinished write for this figure.\n");
+		} else if (skylander.updateData()) {
+			printf("Finished the interrupted write.\n");
+		} else {
+			printf("Couldn't finish the interrupted write; the journal is kept for next time.\n");
+		}
+	}
+	
 	if (read) {
 		Skylander skylander(&pn532);
+		if (adaptive) skylander.setTuner(&tuner);
+		skylander.setImageCache(&imageCache);
 		skylander.read();
 		
 		if (file) {
@@ -162,7 +334,22 @@ int main(int argc, char** argv) {
 	if (write) {
 		if (file) {
 			Skylander skylander(&pn532);
-			if (magic) skylander.magic();
+			PresenceMonitor presence(&pn532);
+			if (presence.poll() == TAG_ARRIVED) skylander.setPresence(&presence);
+			if (adaptive) skylander.setTuner(&tuner);
+			WriteJournal journal(".");
+			skylander.setJournal(&journal);
+			skylander.setImageCache(&imageCache);
+			skylander.setWriteBudget(budget);
+			skylander.setVerify(verify);
+			if (magic) {
+				MagicCache cache("magic.cache");
+				MagicType type = skylander.probeMagic(&cache, writeTest);
+				
+				//-m says the target is magic, so one the probe can't place is taken to be gen2, as it always was
+				if (type == MAGIC_NO_BACKDOOR || type == MAGIC_UNKNOWN) skylander.magic();
+			}
+			if (gen1a) skylander.gen1a();
 			skylander.loadBackup(filename);
 		} else {
 			
@@ -178,6 +365,8 @@ int main(int argc, char** argv) {
 			
 		} else {
 			Skylander skylander(&pn532);
+			if (adaptive) skylander.setTuner(&tuner);
+			skylander.setImageCache(&imageCache);
 			skylander.read();
 			if (decrypt) skylander.decrypt();
 			skylander.dump();
@@ -218,17 +407,207 @@ int main(int argc, char** argv) {
 	
 	if (clone) {
 		Skylander skylander(&pn532);
+		skylander.setImageCache(&imageCache);
 		skylander.read();
 		skylander.makeFile("temp.bin");
 		printf("Press enter when ready.\n");
 		char c;
 		scanf("%c", &c);
 		Skylander skylander2(&pn532);
-		skylander2.magic();
+		MagicCache cache("magic.cache");
+		MagicType type = skylander2.probeMagic(&cache, writeTest);
+		
+		//Cloning always targets a magic card, so one the probe can't place is taken to be gen2
+		if (type == MAGIC_NO_BACKDOOR || type == MAGIC_UNKNOWN) skylander2.magic();
+		if (gen1a) skylander2.gen1a();
+		skylander2.setVerify(verify);
 		skylander2.loadBackup("temp.bin");
 		remove("temp.bin");
 	}
 	
+	if (dictionary) {
+		KeyDictionary keys(dictionaryFile);
+		MIFARE_1K card(&keys, &pn532);
+		card.dump();
+		if (file) card.makeFile(filename);
+	}
+	
+	if (archive) {
+		std::ifstream list(archiveList);
+		std::vector<std::string> sources, destinations;
+		std::string source, destination;
+		
+		while (list >> source >> destination) {
+			sources.push_back(source);
+			destinations.push_back(destination);
+		}
+		
+		std::vector<ArchiveJob> jobs(sources.size());
+		for (size_t i = 0; i < jobs.size(); i++) {
+			jobs[i].source = sources[i].c_str();
+			jobs[i].destination = destinations[i].c_str();
+			jobs[i].done = false;
+			jobs[i].checksums = 0;
+		}
+		
+		ArchiveEngine engine;
+		unsigned int done = engine.run(jobs.data(), jobs.size(), decrypt);
+		printf("%u of %u dumps %s.\n", done, (unsigned int)jobs.size(), decrypt ? "decrypted" : "encrypted");
+		
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (!jobs[i].done) printf("Couldn't read %s\n", jobs[i].source);
+		}
+	}
+	
+	if (health) {
+		std::ifstream list(healthList);
+		std::vector<std::string> sources;
+		std::string source;
+		
+		while (list >> source) {
+			sources.push_back(source);
+		}
+		
+		std::vector<ArchiveJob> jobs(sources.size());
+		for (size_t i = 0; i < jobs.size(); i++) {
+			jobs[i].source = sources[i].c_str();
+			jobs[i].destination = NULL;
+			jobs[i].done = false;
+			jobs[i].checksums = 0;
+		}
+		
+		ArchiveEngine engine;
+		engine.check(jobs.data(), jobs.size());
+		
+		unsigned int healthy = 0;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (!jobs[i].done) {
+				printf("Couldn't read %s\n", jobs[i].source);
+			} else if (jobs[i].checksums != SKYLANDER_CHECKSUMS_VALID) {
+				printf("%s: bad checksums", jobs[i].source);
+				for (uint8_t area = 0; area <= 1; area++) {
+					for (uint8_t type = 0; type <= 4; type++) {
+						if (!(jobs[i].checksums & (1 << (area * 5 + type)))) printf(" area %u type %u", area, type);
+					}
+				}
+				printf("\n");
+			} else {
+				healthy++;
+			}
+		}
+		
+		printf("%u of %u dumps healthy.\n", healthy, (unsigned int)jobs.size());
+	}
+	
+	if (benchmark) {
+		if (!allocationCounting()) {
+			printf("Built without COUNT_ALLOCATIONS: only timing, allocations aren't counted so this can't fail.\n");
+		}
+		
+		//Everything but the radio: the same cycle a kiosk runs per figure, timed and allocation counted per step
+		const char* steps[] = {"load", "open", "decrypt", "edit", "checksum", "encrypt", "write", "validate"};
+		BenchmarkPass offline(steps, sizeof(steps) / sizeof(steps[0]));
+		const unsigned int iterations = 1000;
+		CardImage image;
+		
+		//The first pass is warm up; anything allocated once (like stdout's buffer) isn't steady state
+		for (unsigned int i = 0; i <= iterations; i++) {
+			offline.begin(i > 0);
+			
+			if (!image.load(benchmarkFile)) {
+				printf("Couldn't read %s\n", benchmarkFile);
+				return 1;
+			}
+			offline.mark();
+			
+			Skylander skylander(image, NULL);
+			offline.mark();
+			
+			skylander.decrypt();
+			offline.mark();
+			
+			skylander.setXP(skylander.getXP());
+			offline.mark();
+			
+			skylander.updateChecksums();
+			offline.mark();
+			
+			skylander.encrypt();
+			offline.mark();
+			
+			skylander.makeFile("benchmark.bin");
+			offline.mark();
+			
+			skylander.validateChecksums();
+			offline.mark();
+		}
+		
+		remove("benchmark.bin");
+		uint64_t total = offline.report(iterations);
+		unsigned int cycles = iterations;
+		
+		//With -s, the same again against the figure on the reader, with everything the write path attaches.
+		//The figure's own data is written back, so only blocks that differ from the card (none) go over the air.
+		if (setup) {
+			const char* cardSteps[] = {"detect", "read", "decrypt", "edit", "checksum", "encrypt", "write"};
+			BenchmarkPass card(cardSteps, sizeof(cardSteps) / sizeof(cardSteps[0]));
+			const unsigned int cardIterations = 20;
+			unsigned int done = 0;
+			PresenceMonitor presence(&pn532);
+			WriteJournal journal(".");
+			bool present = (presence.poll() == TAG_ARRIVED);
+			
+			for (unsigned int i = 0; i <= cardIterations; i++) {
+				card.begin(i > 0);
+				
+				Skylander skylander(&pn532);
+				card.mark();
+				
+				if (present) skylander.setPresence(&presence);
+				if (adaptive) skylander.setTuner(&tuner);
+				skylander.setJournal(&journal);
+				skylander.setImageCache(&imageCache);
+				if (!skylander.read()) {
+					printf("Couldn't read the figure.\n");
+					break;
+				}
+				card.mark();
+				
+				skylander.decrypt();
+				card.mark();
+				
+				skylander.setXP(skylander.getXP());
+				card.mark();
+				
+				skylander.updateChecksums();
+				card.mark();
+				
+				skylander.encrypt();
+				card.mark();
+				
+				if (!skylander.updateData()) {
+					printf("Couldn't write the figure.\n");
+					break;
+				}
+				card.mark();
+				
+				if (i > 0) done++;
+			}
+			
+			printf("\nOn the reader:\n");
+			total += card.report(done);
+			cycles += done;
+		}
+		
+		if (allocationCounting()) {
+			if (total) {
+				printf("%llu allocations in %u cycles.\n", (unsigned long long)total, cycles);
+				return 1;
+			}
+			printf("No allocations in %u cycles.\n", cycles);
+		}
+	}
+	
 	if (compare) {
 		uint8_t file1[0x400], file2[0x400];
 		readFile(filename, file1, 0x400);
@@ -241,6 +620,30 @@ int main(int argc, char** argv) {
 		skylander.wipe(true);
 	}
 	
+	if (adaptive) {
+		tuner.printStats();
+	}
+	
+	if (watch) {
+		PresenceMonitor presence(&pn532);
+		uint8_t uid[4];
+		
+		while (true) {
+			switch (presence.poll()) {
+				case TAG_ARRIVED:
+					presence.getUID(uid);
+					printf("Figure placed, UID ");
+					printHexBytes(uid, 4);
+					break;
+				case TAG_REMOVED:
+					printf("Figure removed.\n");
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	
 }
 
 /*
@@ -234,7 +234,7 @@ void MD5Close(MD5 *md5, unsigned char digest[16])
 {
   unsigned char bits[8];
   unsigned int index, padLen;
-  static unsigned char PADDING[64] =
+  static const unsigned char PADDING[64] =
   {
     0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -0,0 +1,189 @@
+#include "md5lanes.h"
+
+typedef uint32_t MD5Vector __attribute__((vector_size(4 * MD5_LANES)));
+
+#if defined(__x86_64__) && defined(__linux__)
+#define MD5_LANE_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define MD5_LANE_CLONES
+#endif
+
+static const uint32_t md5K[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+static const uint8_t md5S[4][4] = {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+
+//One MD5 step on whatever a, b, c and d are in scope, then rotates them round
+#define MD5_STEP(f, i, m) { \
+	t = a + (f) + (m) + md5K[i]; \
+	t = (t << md5S[(i) >> 4][(i) & 3]) | (t >> (32 - md5S[(i) >> 4][(i) & 3])); \
+	a = d; d = c; c = b; b = b + t; \
+}
+
+/*
+
+Description: Runs MD5 over the unshared blocks of MD5_LANES messages.
+
+Arguments:	digests - Final state words, by lane
+			start - State at the start of the first unshared block
+			prefix - State after the shared steps of that block
+			firstStep - How many steps prefix already covers
+			words - Message words by block, word, lane
+			nBlocks - Number of blocks
+
+Returns:
+
+*/
+
+MD5_LANE_CLONES
+static void md5Group(uint32_t digests[4][MD5_LANES], const uint32_t start[4], const uint32_t prefix[4], unsigned int firstStep,
+		const uint32_t words[][16][MD5_LANES], unsigned int nBlocks) {
+	MD5Vector zero = {0};
+	MD5Vector sa = zero + start[0], sb = zero + start[1], sc = zero + start[2], sd = zero + start[3];
+	MD5Vector a = zero + prefix[0], b = zero + prefix[1], c = zero + prefix[2], d = zero + prefix[3];
+	MD5Vector m[16], t;
+	
+	for (unsigned int block = 0; block < nBlocks; block++) {
+		memcpy(m, words[block], sizeof(m));
+		
+		unsigned int i;
+		for (i = block ? 0 : firstStep; i < 16; i++) MD5_STEP((b & c) | (~b & d), i, m[i]);
+		#pragma GCC unroll 16
+		for (i = 16; i < 32; i++) MD5_STEP((b & d) | (c & ~d), i, m[(5 * i + 1) & 0x0F]);
+		#pragma GCC unroll 16
+		for (i = 32; i < 48; i++) MD5_STEP(b ^ c ^ d, i, m[(3 * i + 5) & 0x0F]);
+		#pragma GCC unroll 16
+		for (i = 48; i < 64; i++) MD5_STEP(c ^ (b | ~d), i, m[(7 * i) & 0x0F]);
+		
+		sa += a; sb += b; sc += c; sd += d;
+		a = sa; b = sb; c = sc; d = sd;
+	}
+	
+	memcpy(digests[0], &sa, sizeof(sa));
+	memcpy(digests[1], &sb, sizeof(sb));
+	memcpy(digests[2], &sc, sizeof(sc));
+	memcpy(digests[3], &sd, sizeof(sd));
+}
+
+/*
+
+Description: Gets a little endian word of a message as MD5 pads it (0x80, zeros, then the length in bits).
+
+Arguments:	message - The message
+			len - Its length
+			pos - Byte offset of the word in the padded message
+			total - Padded length
+
+Returns: The word
+
+*/
+
+static uint32_t paddedWord(const unsigned char* message, unsigned int len, unsigned int pos, unsigned int total) {
+	if (pos + 4 <= len) {
+		return message[pos] | (message[pos + 1] << 8) | (message[pos + 2] << 16) | ((uint32_t) message[pos + 3] << 24);
+	}
+	
+	uint64_t bits = (uint64_t) len * 8;
+	uint32_t word = 0;
+	unsigned char byte;
+	
+	for (unsigned int i = 0; i < 4; i++, pos++) {
+		if (pos < len) byte = message[pos];
+		else if (pos == len) byte = 0x80;
+		else if (pos >= total - 8) byte = bits >> (8 * (pos - (total - 8)));
+		else byte = 0x00;
+		
+		word |= (uint32_t) byte << (8 * i);
+	}
+	
+	return word;
+}
+
+/*
+
+Description: Computes the MD5 digests of count messages, all len bytes long, which are identical except for bytes from..to-1.
+			The part before from is only hashed once.  Pass 0 and len if the messages have nothing in common.
+
+Arguments:	digests - Destination, one per message
+			messages - The messages
+			len - Length of each message
+			count - Number of messages
+			from - First byte that differs between messages
+			to - One past the last byte that differs
+
+Returns:
+
+*/
+
+void computeMD5Lanes(unsigned char digests[][16], const unsigned char* const messages[], unsigned int len, unsigned int count, unsigned int from, unsigned int to) {
+	if (count == 0) return;
+	if (to > len) to = len;
+	if (from > to) from = to;
+	
+	unsigned int total = ((len + 8) / 64 + 1) * 64;
+	unsigned int sharedBlocks = from / 64;
+	unsigned int nBlocks = total / 64 - sharedBlocks;
+	
+	if (nBlocks > MD5_LANES_MAX_BLOCKS) {
+		for (unsigned int i = 0; i < count; i++) {
+			computeMD5(digests[i], messages[i], len);
+		}
+		return;
+	}
+	
+	//Whole blocks everyone has in common
+	MD5 md5;
+	MD5Open(&md5);
+	MD5Digest(&md5, messages[0], sharedBlocks * 64);
+	
+	//Round 1 takes the words in order, so the steps using only shared words can be done once as well
+	uint32_t prefix[4], t;
+	uint32_t a = md5.state[0], b = md5.state[1], c = md5.state[2], d = md5.state[3];
+	unsigned int firstStep = (from % 64) / 4;
+	
+	for (unsigned int i = 0; i < firstStep; i++) {
+		MD5_STEP((b & c) | (~b & d), i, paddedWord(messages[0], len, sharedBlocks * 64 + 4 * i, total));
+	}
+	prefix[0] = a; prefix[1] = b; prefix[2] = c; prefix[3] = d;
+	
+	//Every lane starts with the first message's words; only the words overlapping from..to are swapped per lane
+	uint32_t words[MD5_LANES_MAX_BLOCKS][16][MD5_LANES];
+	uint32_t state[4][MD5_LANES];
+	unsigned int firstWord = (from / 4) - sharedBlocks * 16;
+	unsigned int lastWord = ((to + 3) / 4) - sharedBlocks * 16;
+	
+	for (unsigned int word = 0; word < nBlocks * 16; word++) {
+		uint32_t common = paddedWord(messages[0], len, sharedBlocks * 64 + 4 * word, total);
+		for (unsigned int lane = 0; lane < MD5_LANES; lane++) {
+			words[word / 16][word % 16][lane] = common;
+		}
+	}
+	
+	for (unsigned int group = 0; group < count; group += MD5_LANES) {
+		for (unsigned int lane = 0; lane < MD5_LANES; lane++) {
+			//Spare lanes just repeat the last message
+			const unsigned char* message = messages[(group + lane < count) ? group + lane : count - 1];
+			
+			for (unsigned int word = firstWord; word < lastWord; word++) {
+				words[word / 16][word % 16][lane] = paddedWord(message, len, sharedBlocks * 64 + 4 * word, total);
+			}
+		}
+		
+		md5Group(state, md5.state, prefix, firstStep, words, nBlocks);
+		
+		for (unsigned int lane = 0; lane < MD5_LANES && group + lane < count; lane++) {
+			for (unsigned int word = 0; word < 4; word++) {
+				for (unsigned int byte = 0; byte < 4; byte++) {
+					digests[group + lane][4 * word + byte] = state[word][lane] >> (8 * byte);
+				}
+			}
+		}
+	}
+}
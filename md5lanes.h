@@ -0,0 +1,25 @@
+#ifndef _MD5LANES_H_
+#define _MD5LANES_H_
+
+#include "md5.h"
+#include <stdint.h>
+
+/*
+
+MD5 of several equal length messages at once, one message per SIMD lane.
+
+Messages that only differ in a few bytes (like the Skylander key seeds, which only differ in the block number at 0x20)
+have the part before those bytes hashed once: whole shared blocks, then the first steps of the block where they diverge.
+On x86 Linux the kernel is built for AVX2 and plain SSE2 and the right one is picked when the program loads.
+
+*/
+
+//Messages hashed per pass
+#define MD5_LANES 8
+
+//Most blocks the lanes handle past the shared prefix; anything longer goes through computeMD5 one by one
+#define MD5_LANES_MAX_BLOCKS 4
+
+void computeMD5Lanes(unsigned char digests[][16], const unsigned char* const messages[], unsigned int len, unsigned int count, unsigned int from, unsigned int to);
+
+#endif
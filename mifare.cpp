@@ -1,34 +1,57 @@
 #include "mifare.h"
+#include "presence.h"
+#include "rftuner.h"
+#include "journal.h"
+#include "imagecache.h"
+#include "keydict.h"
+#include "cardimage.h"
+#include <chrono>
 
 const uint8_t defaultZero[0x0B] = {0x08, 0x04, 0x00, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69};
 
-MIFARE_1K::MIFARE_1K(PN532* _nfc) : nfc(_nfc), isMagic(false) {
+MIFARE_1K::MIFARE_1K(PN532* _nfc) : nfc(_nfc), presence(NULL), tuner(NULL), journal(NULL), imageCache(NULL), isMagic(false), isGen1a(false), verify(false), haveCardImage(false) {
 	nfc->detectMifare1K(UID);
 	
 	//Puts in all the default values for a factory chip
 	setDefault();
-	memset(altered, 0x00, 0x40);
+	memset(altered, 0x00, sizeof(altered));
 }
 
-MIFARE_1K::MIFARE_1K(uint8_t _keysA[0x10][0x06], PN532* _nfc) : nfc(_nfc), isMagic(false) {
+MIFARE_1K::MIFARE_1K(uint8_t _keysA[Geometry::sectors][0x06], PN532* _nfc) : nfc(_nfc), presence(NULL), tuner(NULL), journal(NULL), imageCache(NULL), isMagic(false), isGen1a(false), verify(false), haveCardImage(false) {
 	//Reads in all the data using the keys
 	nfc->detectMifare1K(UID);
-	memcpy(keysA, _keysA, 0x60);
+	memcpy(keysA, _keysA, sizeof(keysA));
 	read();
 	
 	//Puts in all the stuff into seperate variables
 	dataToParams();
-	memset(altered, 0x00, 0x40);
+	memset(altered, 0x00, sizeof(altered));
 
 }
 
-MIFARE_1K::MIFARE_1K(const char* filename, PN532* _nfc) : nfc(_nfc), isMagic(false) {
-	readFile(filename, &data[0][0], 0x400);
+MIFARE_1K::MIFARE_1K(const char* filename, PN532* _nfc) : nfc(_nfc), presence(NULL), tuner(NULL), journal(NULL), imageCache(NULL), isMagic(false), isGen1a(false), verify(false), haveCardImage(false) {
+	readFile(filename, &data[0][0], Geometry::bytes);
 	dataToParams();
-	memset(altered, 0x00, 0x40);
+	memset(altered, 0x00, sizeof(altered));
 
 }
 
+MIFARE_1K::MIFARE_1K(const CardImage& image, PN532* _nfc) : nfc(_nfc), presence(NULL), tuner(NULL), journal(NULL), imageCache(NULL), isMagic(false), isGen1a(false), verify(false), haveCardImage(false) {
+	//Like the file constructor, nothing touches the reader
+	setImage(image);
+	memset(altered, 0x00, sizeof(altered));
+}
+
+MIFARE_1K::MIFARE_1K(KeyDictionary* dictionary, PN532* _nfc) : nfc(_nfc), presence(NULL), tuner(NULL), journal(NULL), imageCache(NULL), isMagic(false), isGen1a(false), verify(false), haveCardImage(false) {
+	//Reads in all the data, finding the keys as it goes
+	setDefault();
+	nfc->detectMifare1K(UID);
+	read(dictionary);
+	
+	dataToParams();
+	memset(altered, 0x00, sizeof(altered));
+}
+
 /*
 
 Description: Flags the card as being a magic card, allowing writing to block zero.
@@ -45,6 +68,536 @@ void MIFARE_1K::magic() {
 
 /*
 
+Description: Flags the card as a gen1a magic card, which is written through its backdoor with no authentication.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void MIFARE_1K::gen1a() {
+	isMagic = true;
+	isGen1a = true;
+}
+
+/*
+
+Description: Works out what kind of card this is and flags it so later writes take the fastest path that works.
+			By default nothing is written: the card has to answer as a MIFARE Classic 1K (SAK 08), then the backdoor
+			response tells gen1a (both unlock commands ACK'd) and unlocked UFUID (only the first) apart from the rest.
+			Gen2, FUID and genuine cards all look the same from there, and only writeTest tells them apart; without it
+			they are left unflagged, and callers that know the target is magic (-m, --clone) flag it themselves.
+			Definite results are cached by UID, so each card is only probed once.
+
+Arguments:	cache - Cache of previous results (may be NULL)
+			writeTest - Allowed to write block zero back to itself to find out (locks an unlocked FUID)
+
+Returns: The card type
+
+*/
+
+MagicType MIFARE_1K::probeMagic(MagicCache* cache, bool writeTest) {
+	//A write test was asked for, so it runs whatever an earlier probe found
+	MagicType type = (cache && !writeTest) ? cache->lookup(UID) : MAGIC_UNKNOWN;
+	
+	if (type == MAGIC_UNKNOWN) {
+		uint8_t atqa[2], sak;
+		nfc->getTargetInfo(atqa, &sak);
+		
+		if (sak != 0x08) {
+			printf("SAK of %02X, not a MIFARE Classic 1K.\n", sak);
+			return MAGIC_UNKNOWN;
+		}
+		
+		uint8_t backdoor = nfc->probeBackdoor();
+		
+		if (backdoor == 2) {
+			type = MAGIC_GEN1A;
+		} else if (backdoor == 1) {
+			type = MAGIC_ONE_TIME;
+		} else if (writeTest) {
+			type = writeTestBlockZero();
+		} else {
+			type = MAGIC_NO_BACKDOOR;
+		}
+		
+		//Inconclusive results are never cached, so a later write test still runs
+		if (cache && type != MAGIC_NO_BACKDOOR) cache->store(UID, type);
+	}
+	
+	printf("Card is %s.\n", magicTypeName(type));
+	
+	switch (type) {
+		case MAGIC_GEN1A:
+			gen1a();
+			break;
+		case MAGIC_GEN2:
+		case MAGIC_ONE_TIME:
+			magic();
+			break;
+		default:
+			break;
+	}
+	
+	return type;
+}
+
+/*
+
+Description: Tells gen2, FUID and genuine cards apart by writing block zero back to itself, twice.  Genuine cards refuse
+			the first write and gen2 cards accept both.  An unlocked FUID accepts the first, which locks it with its
+			current UID, and so refuses the second.
+
+Arguments:	
+
+Returns: The card type (MAGIC_NONE for an FUID that is now locked), or MAGIC_UNKNOWN if block zero couldn't be read
+
+*/
+
+MagicType MIFARE_1K::writeTestBlockZero() {
+	uint8_t defaultKey[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+	uint8_t blockZero[Geometry::blockSize];
+	uint8_t* key = keysA[0];
+	MagicType type = MAGIC_UNKNOWN;
+	
+	//Blanks still have the factory key
+	if (!nfc->MifareClassic_AuthenticateBlock(0x00, UID, true, key)) {
+		key = defaultKey;
+		if (!reselect() || !nfc->MifareClassic_AuthenticateBlock(0x00, UID, true, key)) {
+			reselect();
+			return MAGIC_UNKNOWN;
+		}
+	}
+	
+	if (nfc->MifareClassic_ReadBlock(0x00, blockZero)) {
+		if (!nfc->MifareClassic_WriteBlock(0x00, blockZero)) {
+			type = MAGIC_NONE;
+		} else if (nfc->MifareClassic_WriteBlock(0x00, blockZero)) {
+			type = MAGIC_GEN2;
+		} else {
+			printf("Card was an unlocked FUID, and is now locked.\n");
+			type = MAGIC_NONE;
+		}
+	}
+	
+	//A refused write halts the card
+	reselect();
+	return type;
+}
+
+/*
+
+Description: Attaches a presence monitor, which long operations use to stop as soon as the figure is removed.
+
+Arguments:	_presence - The monitor to use (NULL to disable)
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setPresence(PresenceMonitor* _presence) {
+	presence = _presence;
+}
+
+/*
+
+Description: Checks the presence heartbeat, if one is attached.  Must only be called before authenticating a sector.
+
+Arguments:	
+
+Returns: False if the figure has been removed
+
+*/
+
+bool MIFARE_1K::checkPresence() {
+	if (presence == NULL) return true;
+	
+	if (presence->stillPresent()) return true;
+	
+	printf("Figure was removed, aborting.\n");
+	return false;
+}
+
+/*
+
+Description: Sets how failed block commands are retried.
+
+Arguments:	_retry - The policy to use
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setRetryPolicy(RetryPolicy _retry) {
+	retry = _retry;
+}
+
+/*
+
+Description: Attaches an RF tuner, which is given the outcome and time of every block command.
+
+Arguments:	_tuner - The tuner to use (NULL to disable)
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setTuner(RFTuner* _tuner) {
+	tuner = _tuner;
+}
+
+/*
+
+Description: Attaches a write-ahead journal, so an interrupted updateData can be finished later.
+
+Arguments:	_journal - The journal to use (NULL to disable)
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setJournal(WriteJournal* _journal) {
+	journal = _journal;
+}
+
+/*
+
+Description: Loads an unfinished write for this card from the journal.  Call updateData afterwards to finish it.
+
+Arguments:	
+
+Returns: True if there was an unfinished write
+
+*/
+
+bool MIFARE_1K::resumeJournal() {
+	if (journal == NULL) return false;
+	
+	if (!journal->resume(UID, data, altered)) return false;
+	
+	dataToParams();
+	return true;
+}
+
+/*
+
+Description: Attaches an image cache.  read() then only does a full read when the fingerprint blocks differ from the cache.
+
+Arguments:	_imageCache - The cache to use (NULL to disable)
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setImageCache(ImageCache* _imageCache) {
+	imageCache = _imageCache;
+}
+
+/*
+
+Description: Sets how long updateData has to write everything.  A write that is not expected to finish in time
+			stops before its last blocks, leaving the card on its old (still valid) data.
+
+Arguments:	millis - Budget in ms (0 for no limit)
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setWriteBudget(uint32_t millis) {
+	scheduler.setBudget(millis);
+}
+
+/*
+
+Description: Turns on read-back verification in updateData.  Each written block is read back while its sector is still
+			authenticated and written again if it doesn't match, which costs one read per written block.
+
+Arguments:	_verify - Whether to verify
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setVerify(bool _verify) {
+	verify = _verify;
+}
+
+/*
+
+Description: Gives the order blocks should be written in by updateData (lowest first).  Plain MIFARE data has
+			no structure, so every block is the same.
+
+Arguments:	priority - Destination for the priority of each block
+
+Returns: 
+
+*/
+
+void MIFARE_1K::writePriorities(uint8_t priority[Geometry::blocks]) {
+	memset(priority, 0x00, Geometry::blocks);
+}
+
+/*
+
+Description: Unflags altered blocks whose data is the same as what is already on the card.  Does nothing unless the
+			card has been read (or written) during this session.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void MIFARE_1K::elideUnchanged() {
+	if (!haveCardImage) return;
+	
+	for (uint8_t block = 0x01; block < Geometry::blocks; block++) {
+		if (altered[block] && memcmp(data[block], cardImage[block], 0x10) == 0) {
+			altered[block] = false;
+		}
+	}
+}
+
+/*
+
+Description: Reads a block back from the card and checks it against the object's data, rewriting it if it doesn't match.
+			The block's sector must already be authenticated.
+
+Arguments:	block - which block to check
+
+Returns: Success boolean - false if it still doesn't match after the retry policy's attempts
+
+*/
+
+bool MIFARE_1K::verifyBlock(uint8_t block) {
+	for (uint8_t attempt = 0; ; attempt++) {
+		if (readBackMatches(block)) return true;
+		
+		if (!retry.backoff(attempt)) return false;
+		
+		printf("Block 0x%02X did not verify, writing it again.\n", block);
+		if (!transferBlock(block, true)) return false;
+	}
+}
+
+/*
+
+Description: Reads a block and compares it with the object's data.  Sector trailers read back with key A (and usually
+			key B) hidden, so only their access bits are compared; the keys are proven by the next authentication.
+			The block's sector must already be authenticated.
+
+Arguments:	block - which block to check
+
+Returns: True if it matches
+
+*/
+
+bool MIFARE_1K::readBackMatches(uint8_t block) {
+	uint8_t readBack[Geometry::blockSize];
+	
+	if (!nfc->MifareClassic_ReadBlock(block, readBack)) return false;
+	
+	if (isTrailerBlock(block)) return (memcmp(readBack + 0x06, data[block] + 0x06, 0x04) == 0);
+	return (memcmp(readBack, data[block], 0x10) == 0);
+}
+
+/*
+
+Description: Reads the whole card back with the object's keys and compares it with the object's data.
+
+Arguments:	
+
+Returns: True if every block matches
+
+*/
+
+bool MIFARE_1K::verifyImage() {
+	for (uint8_t block = 0; block < Geometry::blocks; block++) {
+		if (isFirstBlock(block)) {
+			if (!checkPresence()) return false;
+			if (!authenticateSector(blockToSector(block))) return false;
+		}
+		
+		if (!readBackMatches(block)) {
+			printf("Block 0x%02X did not verify.\n", block);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+/*
+
+Description: Gives the blocks that change whenever the card's contents do, which read() compares against the image cache.
+			Plain MIFARE data has no such blocks: any block can change on its own, and the trailers read back with
+			their keys hidden, so no subset proves the rest is unchanged.  The base class therefore opts out (returns
+			0), which makes readCached() always do a full read; subclasses with a known layout (e.g. Skylander's save
+			counters) override this.
+
+Arguments:	blocks - Destination for the block numbers (unused here)
+
+Returns: Number of blocks
+
+*/
+
+uint8_t MIFARE_1K::fingerprintBlocks(uint8_t[Geometry::blocks]) {
+	return 0;
+}
+
+/*
+
+Description: Loads the card's image from the image cache if the fingerprint blocks on the card still match it.
+
+Arguments:	
+
+Returns: True if the cached image was used
+
+*/
+
+bool MIFARE_1K::readCached() {
+	uint8_t blocks[Geometry::blocks], cached[Geometry::blocks][Geometry::blockSize], current[Geometry::blockSize];
+	uint8_t sector, authenticated = 0xFF;
+	uint8_t count = fingerprintBlocks(blocks);
+	
+	if (imageCache == NULL || count == 0) return false;
+	if (!imageCache->load(UID, cached)) return false;
+	
+	for (uint8_t i = 0; i < count; i++) {
+		sector = blockToSector(blocks[i]);
+		
+		if (sector != authenticated) {
+			if (!checkPresence()) return false;
+			if (!authenticateSector(sector)) return false;
+			authenticated = sector;
+		}
+		
+		if (!nfc->MifareClassic_ReadBlock(blocks[i], current)) return false;
+		if (memcmp(current, cached[blocks[i]], 0x10)) return false;
+	}
+	
+	memcpy(data, cached, Geometry::bytes);
+	memcpy(cardImage, cached, Geometry::bytes);
+	haveCardImage = true;
+	
+	return true;
+}
+
+/*
+
+Description: Saves the session image to the image cache, after it has been brought up to date.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void MIFARE_1K::cacheCardImage() {
+	if (imageCache && haveCardImage) imageCache->store(UID, cardImage);
+}
+
+static uint32_t microsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+
+Description: Brings the card back to the selected state after it has dropped out (e.g. a failed authentication halts it).
+
+Arguments:	
+
+Returns: Success boolean - false if a different card (or none) answered
+
+*/
+
+bool MIFARE_1K::reselect() {
+	uint8_t uid[4];
+	
+	if (!checkPresence()) return false;
+	if (!nfc->autoPoll(uid, 0x01, 0x01)) return false;
+	
+	return (memcmp(uid, UID, 4) == 0);
+}
+
+/*
+
+Description: Authenticates a sector with its key A, selecting the card again between attempts if needed.
+
+Arguments:	sector - which sector to authenticate
+
+Returns: Success boolean
+
+*/
+
+bool MIFARE_1K::authenticateSector(uint8_t sector) {
+	uint8_t block = sectorToBlock(sector);
+	
+	bool success;
+	
+	for (uint8_t attempt = 0; ; attempt++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		success = nfc->MifareClassic_AuthenticateBlock(block, UID, true, keysA[sector]);
+		
+		//Read before the tuner runs, as retuning sends commands of its own that reset it
+		uint8_t status = nfc->getLastError();
+		if (tuner) tuner->record(success, microsSince(start));
+		
+		if (success) return true;
+		
+		if (retry.classify(status) == RETRY_ABORT) return false;
+		if (!retry.backoff(attempt)) return false;
+		
+		//Any failed authentication leaves the card halted
+		if (!reselect()) return false;
+	}
+}
+
+/*
+
+Description: Reads or writes one block of the object's data, retrying according to the retry policy.  The block's sector
+			must already be authenticated.  Only this block is repeated, so earlier blocks are never redone.
+
+Arguments:	block - which block to transfer
+			write - true to write the block to the card, false to read it from the card
+
+Returns: Success boolean
+
+*/
+
+bool MIFARE_1K::transferBlock(uint8_t block, bool write) {
+	RetryAction action;
+	bool success;
+	
+	for (uint8_t attempt = 0; ; attempt++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		
+		if (write) {
+			success = nfc->MifareClassic_WriteBlock(block, data[block]);
+		} else {
+			success = nfc->MifareClassic_ReadBlock(block, data[block]);
+		}
+		
+		uint8_t status = nfc->getLastError();
+		if (tuner) tuner->record(success, microsSince(start));
+		if (success) return true;
+		
+		action = retry.classify(status);
+		
+		if (action == RETRY_ABORT) return false;
+		if (!retry.backoff(attempt)) return false;
+		
+		if (action == RETRY_SECTOR) {
+			if (!reselect()) return false;
+			if (!authenticateSector(blockToSector(block))) return false;
+		}
+	}
+}
+
+/*
+
 Description: Writes all the 1kB of data to a file.
 
 Arguments:	filename - Name of the file.
@@ -54,7 +607,45 @@ Returns:
 */
 
 void MIFARE_1K::makeFile(const char* filename) {
-	writeFile(filename, &data[0][0], 0x400);
+	writeFile(filename, &data[0][0], Geometry::bytes);
+}
+
+/*
+
+Description: Copies the data and the altered blocks into a compact CardImage.
+
+Arguments:	image - Where to put it
+
+Returns: 
+
+*/
+
+void MIFARE_1K::getImage(CardImage* image) {
+	memcpy(image->data, data, Geometry::bytes);
+	image->dirty = 0;
+	
+	for (uint8_t block = 0; block < Geometry::blocks; block++) {
+		if (altered[block]) image->dirty |= (1ULL << block);
+	}
+}
+
+/*
+
+Description: Takes the data from a CardImage, with its dirty blocks marked as altered so updateData writes them.
+
+Arguments:	image - The image to load
+
+Returns: 
+
+*/
+
+void MIFARE_1K::setImage(const CardImage& image) {
+	memcpy(data, image.data, Geometry::bytes);
+	dataToParams();
+	
+	for (uint8_t block = 0; block < Geometry::blocks; block++) {
+		altered[block] = image.isDirty(block);
+	}
 }
 
 /*
@@ -68,7 +659,7 @@ Returns:
 */
 
 void MIFARE_1K::dump() {
-	printHexBytes(data[0], 0x400, true);
+	printHexBytes(data[0], Geometry::bytes, true);
 }
 
 /*
@@ -82,7 +673,7 @@ Returns: Success boolean
 */
 
 bool MIFARE_1K::wipe() {
-	for (uint8_t sector = 0x00; sector < 0x10; sector++) {
+	for (uint8_t sector = 0x00; sector < Geometry::sectors; sector++) {
 		wipeSector(sector);
 	}
 	return updateData();
@@ -90,7 +681,7 @@ bool MIFARE_1K::wipe() {
 
 bool MIFARE_1K::wipe(bool preserve) {
 	if (preserve) {
-		for (uint8_t sector = 0x01; sector < 0x10; sector++) {
+		for (uint8_t sector = 0x01; sector < Geometry::sectors; sector++) {
 			wipeSector(sector);
 		}
 	return updateData();
@@ -113,12 +704,12 @@ void MIFARE_1K::wipeSector(uint8_t sector) {
 
 	//Don't wipe block zero
 	if (sector == 0x00) {
-		memset(data[1], 0x00, 0x20);
-		memset(altered + 1, 0xff, 0x02);
+		memset(data[1], 0x00, (Geometry::sectorBlocks - 2) * Geometry::blockSize);
+		memset(altered + 1, 0xff, Geometry::sectorBlocks - 2);
 	} else {
-		uint8_t block = sectorToBlock(sector) - 3;
-		memset(data[block], 0x00, 0x30);
-		memset(&altered[block], 0xff, 0x03);
+		uint8_t block = Geometry::firstBlock(sector);
+		memset(data[block], 0x00, (Geometry::sectorBlocks - 1) * Geometry::blockSize);
+		memset(&altered[block], 0xff, Geometry::sectorBlocks - 1);
 	}
 }
 
@@ -133,7 +724,7 @@ Returns: Success boolean
 
 */
 
-bool MIFARE_1K::setBlock(uint8_t block, uint8_t in[0x10]) {
+bool MIFARE_1K::setBlock(uint8_t block, uint8_t in[Geometry::blockSize]) {
 	if (isTrailerBlock(block)) return false;
 	if (block == 0) return false; //This should be done with the special function for magic cards.
 	
@@ -171,7 +762,7 @@ Returns:
 
 */
 
-void MIFARE_1K::getBlock(uint8_t block, uint8_t destination[0x10]) {
+void MIFARE_1K::getBlock(uint8_t block, uint8_t destination[Geometry::blockSize]) {
 	memcpy(destination, data[block], 0x10);
 }
 
@@ -188,24 +779,101 @@ Returns: Success boolean
 bool MIFARE_1K::read() {
 	if (!nfc->select(0x01)) return false;
 	
-	for (uint8_t block = 0; block < 0x40; block++) {
+	if (readCached()) return true;
+	
+	for (uint8_t block = 0; block < Geometry::blocks; block++) {
 		if (isFirstBlock(block)) {
-			if (!nfc->MifareClassic_AuthenticateBlock(block, UID, true, keysA[block/4])) return false;
+			if (!checkPresence()) return false;
+			if (!authenticateSector(Geometry::blockToSector(block))) return false;
 		}
 
-		if (!nfc->MifareClassic_ReadBlock(block, data[block])) return false;	
+		if (!transferBlock(block, false)) return false;	
 		
 		if (isTrailerBlock(block)) {
 			//since keyA not readable, the card will return all zeroes so we must fill in the real data
-			memcpy(data[block], keysA[block/4], 0x06);
+			memcpy(data[block], keysA[Geometry::blockToSector(block)], 0x06);
 		}
 	}
 	
+	memcpy(cardImage, data, Geometry::bytes);
+	haveCardImage = true;
+	cacheCardImage();
+	
 	return true;
 }
 
 /*
 
+Description: Reads the entire contents of a card whose keys aren't known, trying the dictionary's keys for each sector.
+			The keys that work are kept on the object and recorded in the dictionary.
+
+Arguments:	dictionary - Candidate keys
+
+Returns: Success boolean
+
+*/
+
+bool MIFARE_1K::read(KeyDictionary* dictionary) {
+	if (!nfc->select(0x01)) return false;
+	
+	for (uint8_t block = 0; block < Geometry::blocks; block++) {
+		if (isFirstBlock(block)) {
+			if (!checkPresence()) return false;
+			if (!findKey(Geometry::blockToSector(block), dictionary)) {
+				printf("No key found for sector %u.\n", Geometry::blockToSector(block));
+				dictionary->save();
+				return false;
+			}
+		}
+
+		if (!transferBlock(block, false)) return false;	
+		
+		if (isTrailerBlock(block)) {
+			memcpy(data[block], keysA[Geometry::blockToSector(block)], 0x06);
+		}
+	}
+	
+	dictionary->save();
+	
+	memcpy(cardImage, data, Geometry::bytes);
+	haveCardImage = true;
+	
+	return true;
+}
+
+/*
+
+Description: Authenticates a sector by trying the dictionary's keys in order, selecting the card again after each miss.
+
+Arguments:	sector - which sector to authenticate
+			dictionary - Candidate keys
+
+Returns: Success boolean - the key that worked is stored in keysA
+
+*/
+
+bool MIFARE_1K::findKey(uint8_t sector, KeyDictionary* dictionary) {
+	uint8_t keys[0x40][0x06];
+	uint8_t count = dictionary->candidates(UID, sector, keys, 0x40);
+	
+	for (uint8_t i = 0; i < count; i++) {
+		if (nfc->MifareClassic_AuthenticateBlock(sectorToBlock(sector), UID, true, keys[i])) {
+			memcpy(keysA[sector], keys[i], 0x06);
+			dictionary->hit(UID, sector, keys[i]);
+			return true;
+		}
+		
+		dictionary->miss(keys[i]);
+		
+		//A failed authentication halts the card
+		if (!reselect()) return false;
+	}
+	
+	return false;
+}
+
+/*
+
 Description: Sets all the data and sector trailers to factory values.
 
 Arguments:	
@@ -215,16 +883,16 @@ Returns:
 */
 
 void MIFARE_1K::setDefault() {
-	memset(&data[1][0], 0x00, 0x3F0);
-	memset(keysA, 0xFF, 0x60);
-	memset(keysB, 0xFF, 0x60);
+	memset(&data[1][0], 0x00, Geometry::bytes - Geometry::blockSize);
+	memset(keysA, 0xFF, sizeof(keysA));
+	memset(keysB, 0xFF, sizeof(keysB));
 	memcpy(data[0] + 0x05, defaultZero, 0x0B);
 	
-	for (uint8_t sector = 0; sector < 0x10; sector++) {
+	for (uint8_t sector = 0; sector < Geometry::sectors; sector++) {
 		accessBits[sector][0] = 0xFF;
 		accessBits[sector][1] = 0x07;
 		accessBits[sector][2] = 0x80;
-		data[sector * 4 + 3][0x09] = 0x69;
+		data[Geometry::trailerBlock(sector)][0x09] = 0x69;
 
 	}
 		
@@ -247,7 +915,7 @@ void MIFARE_1K::paramsToData() {
 	calcBCC();
 	
 	uint8_t block;
-	for (uint8_t sector = 0; sector < 0x10; sector++) {
+	for (uint8_t sector = 0; sector < Geometry::sectors; sector++) {
 		block = sectorToBlock(sector);
 		memcpy(data[block], keysA[sector], 0x06);
 		memcpy(data[block] + 0x06, accessBits[sector], 0x03);
@@ -270,7 +938,7 @@ void MIFARE_1K::dataToParams() {
 	calcBCC();
 	
 	uint8_t block;
-	for (uint8_t sector = 0; sector < 0x10; sector++) {
+	for (uint8_t sector = 0; sector < Geometry::sectors; sector++) {
 		block = sectorToBlock(sector);
 		memcpy(keysA[sector], data[block], 0x06);
 		memcpy(accessBits[sector], data[block] + 0x06, 0x03);
@@ -290,28 +958,140 @@ Returns: Success boolean
 
 bool MIFARE_1K::updateData() {
 
-	//We write to the actual card in this way so that authentication operations are minimised.
+	//Blocks are written in the order given by writePriorities, and each sector is only authenticated when the next block is in a different one.
 	//You shouldn't change keys this way; only data.  Also block zero should only be changed with the dedicated function.
 	
-	bool authenticated[0x10];
-	uint8_t sector;
-	memset(authenticated, 0x00, 0x10);
-	
-	for (uint8_t block = 0x01; block < 0x40; block++) {
-		if (!isTrailerBlock(block)) {
-			if (altered[block]) {
-				sector = blockToSector(block);
-				if (!authenticated[sector]) {
-					if (!nfc->MifareClassic_AuthenticateBlock(block, UID, true, keysA[sector])) return false;
-					authenticated[sector] = true;
-				}
-				if (!nfc->MifareClassic_WriteBlock(block, data[block])) return false;
-			}
+	uint8_t priority[Geometry::blocks];
+	uint8_t order[Geometry::blocks];
+	uint8_t count, block, sector;
+	uint8_t authenticated = 0xFF;
+	std::chrono::steady_clock::time_point start;
+	
+	elideUnchanged();
+	
+	if (journal) {
+		if (!journal->begin(UID, data, altered)) return false;
+	}
+	
+	writePriorities(priority);
+	count = scheduler.plan(order, priority, altered);
+	scheduler.start();
+	
+	for (uint8_t i = 0; i < count; i++) {
+		block = order[i];
+		sector = blockToSector(block);
+		
+		if (!scheduler.fits(order + i, count - i, authenticated)) {
+			printf("Not enough time left to finish writing, stopping before block 0x%02X.\n", block);
+			return false;
 		}
 		
+		if (sector != authenticated) {
+			if (!checkPresence()) return false;
+			
+			start = std::chrono::steady_clock::now();
+			if (!authenticateSector(sector)) return false;
+			scheduler.recordAuth(microsSince(start));
+			
+			authenticated = sector;
+		}
+		
+		start = std::chrono::steady_clock::now();
+		if (!transferBlock(block, true)) return false;
+		if (verify && !verifyBlock(block)) return false;
+		scheduler.recordWrite(microsSince(start));
+		
+		//Cleared as we go, so calling this again after a failure only writes what is left
+		altered[block] = false;
+		memcpy(cardImage[block], data[block], 0x10);
+		if (journal) journal->complete(block);
+	}
+	
+	if (journal) journal->finish();
+	cacheCardImage();
+	return true;
+}
+
+/*
+
+Description: Writes the entire image, including block zero and the sector trailers, to a gen1a magic card in one pass.
+			With verify set, the card is then read back with the new keys, and the whole image written again if any
+			block doesn't match (block zero can only be rewritten through the backdoor).
+
+Arguments:	
+
+Returns: Success boolean
+
+*/
+
+bool MIFARE_1K::writeAll() {
+	if (!isGen1a) return false;
+	
+	paramsToData();
+	
+	for (uint8_t attempt = 0; ; attempt++) {
+		if (!nfc->writeGen1a(data)) return false;
+		if (!verify || verifyImage()) break;
+		
+		if (!retry.backoff(attempt)) return false;
+		printf("Image did not verify, writing it again.\n");
+	}
+	
+	memset(altered, 0x00, sizeof(altered));
+	memcpy(cardImage, data, Geometry::bytes);
+	haveCardImage = true;
+	cacheCardImage();
+	
+	return true;
+}
+
+/*
+
+Description: Writes an entire image, block zero and trailers included, to a gen2 magic card with one authentication per sector.
+			Each sector's data blocks go first and its trailer last, so the current key stays valid until the sector is done.
+			Sector zero is done last with block zero at the very end, since it changes the UID used to authenticate.
+			With verify set, each block is read back straight after it is written, while the sector is still
+			authenticated, exactly as updateData does.
+
+Arguments:	image - The full image to write, including the trailers (new keys and access bits)
+
+Returns: Success boolean
+
+*/
+
+bool MIFARE_1K::provision(uint8_t image[Geometry::blocks][Geometry::blockSize]) {
+	if (!isMagic) return false;
+	
+	memcpy(data, image, Geometry::bytes);
+	calcBCC();
+	
+	//Sectors 1 to 15, then 0
+	for (uint8_t i = 1; i <= Geometry::sectors; i++) {
+		uint8_t sector = i % Geometry::sectors;
+		uint8_t trailer = sectorToBlock(sector);
+		
+		if (!checkPresence()) return false;
+		if (!authenticateSector(sector)) return false;
+		
+		for (uint8_t block = trailer - 3; block <= trailer; block++) {
+			if (block == 0x00) continue;
+			if (!transferBlock(block, true)) return false;
+			if (verify && !verifyBlock(block)) return false;
+		}
+		
+		if (sector == 0x00) {
+			if (!transferBlock(0x00, true)) return false;
+			if (verify && !verifyBlock(0x00)) return false;
+		}
 	}
 	
-	memset(altered, 0x00, 0x40);
+	//The card now has the new UID and keys
+	dataToParams();
+	memset(altered, 0x00, sizeof(altered));
+	memcpy(cardImage, data, Geometry::bytes);
+	haveCardImage = true;
+	cacheCardImage();
+	
 	return true;
 }
 
@@ -420,21 +1200,3 @@ bool MIFARE_1K::changeBlockZero(uint8_t in[0x0B]) {
 	
 	return true;
 }
-
-
-
-bool isTrailerBlock(uint8_t block) {
-	return (block % 4 == 3);
-}
-
-bool isFirstBlock(uint8_t block) {
-	return (block % 4 == 0);
-}
-
-uint8_t blockToSector(uint8_t block) {
-	return (block - (block % 4))/4;
-}
-
-uint8_t sectorToBlock(uint8_t sector) {
-	return (sector * 4 + 3);
-}
\ No newline at end of file
@@ -3,29 +3,56 @@
 
 #include "misc.h"
 #include "pn532.h"
+#include "retry.h"
+#include "scheduler.h"
+#include "magic.h"
+#include "geometry.h"
 #include <memory.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <fstream>
 
 class PN532;
+class PresenceMonitor;
+class RFTuner;
+class WriteJournal;
+class ImageCache;
+class KeyDictionary;
+struct CardImage;
 
 
 class MIFARE_1K {
 	public:
+		typedef Mifare1K Geometry;
+		
 		MIFARE_1K(PN532* _nfc);
-		MIFARE_1K(uint8_t _keysA[0x10][0x06], PN532* _nfc);
+		MIFARE_1K(uint8_t _keysA[Geometry::sectors][0x06], PN532* _nfc);
 		MIFARE_1K(const char* filename, PN532* _nfc);
+		MIFARE_1K(const CardImage& image, PN532* _nfc);
+		MIFARE_1K(KeyDictionary* dictionary, PN532* _nfc);
 		
 		void magic();
+		void gen1a();
+		MagicType probeMagic(MagicCache* cache, bool writeTest = false);
+		void setPresence(PresenceMonitor* _presence);
+		void setRetryPolicy(RetryPolicy _retry);
+		void setTuner(RFTuner* _tuner);
+		void setJournal(WriteJournal* _journal);
+		bool resumeJournal();
+		void setImageCache(ImageCache* _imageCache);
+		void setWriteBudget(uint32_t millis);
+		void setVerify(bool _verify);
 		
 		void dump();
 		bool updateData();
+		bool writeAll();
+		bool provision(uint8_t image[Geometry::blocks][Geometry::blockSize]);
 		
 		bool read();
+		bool read(KeyDictionary* dictionary);
 		
-		bool setBlock(uint8_t block, uint8_t in[0x10]);
-		void getBlock(uint8_t block, uint8_t destination[0x10]);
+		bool setBlock(uint8_t block, uint8_t in[Geometry::blockSize]);
+		void getBlock(uint8_t block, uint8_t destination[Geometry::blockSize]);
 		bool setKeyA(uint8_t sector, uint8_t key[6]);
 		void getKeyA(uint8_t sector, uint8_t destination[6]);
 
@@ -36,19 +63,33 @@ class MIFARE_1K {
 		void wipeSector(uint8_t sector);
 		
 		void makeFile(const char* filename);
+		void getImage(CardImage* image);
+		void setImage(const CardImage& image);
 		
 	protected:
 		PN532* nfc;
+		PresenceMonitor* presence;
+		RetryPolicy retry;
+		RFTuner* tuner;
+		WriteJournal* journal;
+		ImageCache* imageCache;
+		WriteScheduler scheduler;
 		bool isMagic;
+		bool isGen1a;
+		bool verify;
 	
-		uint8_t keysA[0x10][0x06];
-		uint8_t keysB[0x10][0x06];
-		uint8_t accessBits[0x10][0x03];
+		uint8_t keysA[Geometry::sectors][0x06];
+		uint8_t keysB[Geometry::sectors][0x06];
+		uint8_t accessBits[Geometry::sectors][0x03];
 		uint8_t UID[4];
 		
-		bool altered[0x40];
+		bool altered[Geometry::blocks];
+		
+		uint8_t data[Geometry::blocks][Geometry::blockSize];
 		
-		uint8_t data[0x40][0x10];
+		//Last known contents of the physical card, so unchanged blocks aren't rewritten
+		uint8_t cardImage[Geometry::blocks][Geometry::blockSize];
+		bool haveCardImage;
 		
 		void setDefault();
 		void paramsToData();
@@ -56,6 +97,22 @@ class MIFARE_1K {
 		void calcBCC();
 		
 		bool flag(uint8_t block);
+		bool checkPresence();
+		void elideUnchanged();
+		
+		virtual void writePriorities(uint8_t priority[Geometry::blocks]);
+		virtual uint8_t fingerprintBlocks(uint8_t blocks[Geometry::blocks]);
+		bool readCached();
+		void cacheCardImage();
+		
+		bool reselect();
+		MagicType writeTestBlockZero();
+		bool authenticateSector(uint8_t sector);
+		bool transferBlock(uint8_t block, bool write);
+		bool verifyBlock(uint8_t block);
+		bool readBackMatches(uint8_t block);
+		bool verifyImage();
+		bool findKey(uint8_t sector, KeyDictionary* dictionary);
 
 
 
@@ -67,10 +124,6 @@ class MIFARE_1K {
 
 };
 
-bool isTrailerBlock(uint8_t block);
-bool isFirstBlock(uint8_t block);
-uint8_t blockToSector(uint8_t block);
-uint8_t sectorToBlock(uint8_t sector);
 
 
 
@@ -65,27 +65,36 @@ uint64_t bytesToInt(uint8_t* data, uint8_t len) {
 	
 }
 
-void readFile(const char* filename, uint8_t destination[], int nBytes) {
-	std::ifstream file(filename, std::ios::in | std::ios::binary);
-	
-	char* buffer;
-	buffer = (char *)malloc(nBytes);
+//Plain file descriptors rather than streams, which allocate a buffer every time they're opened
+
+bool readFile(const char* filename, uint8_t destination[], int nBytes) {
+	int file = open(filename, O_RDONLY);
+	if (file < 0) return false;
 	
-	file.read(buffer, nBytes);
-	file.close();
+	int total = 0;
+	while (total < nBytes) {
+		ssize_t n = read(file, destination + total, nBytes - total);
+		if (n <= 0) break;
+		total += n;
+	}
 	
-	memcpy(destination, buffer, nBytes);
-
-	free(buffer);
-
+	close(file);
+	return (total == nBytes);
 }
 
-void writeFile(const char* filename, uint8_t data[], int nBytes) {
-	std::ofstream file(filename, std::ios::out | std::ios::binary);
+bool writeFile(const char* filename, const uint8_t data[], int nBytes) {
+	int file = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) return false;
 	
-	file.write((char *)data, nBytes);
-	file.close();
-
+	int total = 0;
+	while (total < nBytes) {
+		ssize_t n = write(file, data + total, nBytes - total);
+		if (n <= 0) break;
+		total += n;
+	}
+	
+	close(file);
+	return (total == nBytes);
 }
 
 void compareBytes(uint8_t* array1, uint8_t* array2, int nBytes) {
@@ -95,20 +104,21 @@ void compareBytes(uint8_t* array1, uint8_t* array2, int nBytes) {
 	printf("\n\n\nData 2:\n");
 	printHexBytes(array2, nBytes, true);
 	
-	uint8_t* difference = (uint8_t *)malloc(nBytes);
-	memset(difference, 0x00, nBytes);
-	
 	for (int i = 0; i < nBytes; i++) {
 		if (array1[i] != array2[i]) {
 			printf("Data differs at byte 0x%04X, Data 1 contains 0x%02X and Data 2 contains 0x%02X.\n", i, array1[i], array2[i]);
-			difference[i] = 0xff;	
 		}
 	} 
 	
+	//Same layout as printHexBytes, worked out as it goes instead of from a copy
 	printf("\n\n\nDifferences:\n");
-	printHexBytes(difference, nBytes, true);
-	
-	free(difference);
+	for (int i = 0; i < nBytes; i++) {
+		if (i % 0x10 == 0x00) {
+			printf("\n\nBlock 0x%02x: ", i >> 4);
+		}
+		printf("%02hhX ", (array1[i] != array2[i]) ? 0xFF : 0x00);
+	}
+	printf("\n\n");
 }
 
 
@@ -6,6 +6,8 @@
 #include <memory.h>
 #include <stdio.h>
 #include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 
 
 
@@ -18,13 +20,17 @@ uint8_t charToHex(unsigned char input);
 bool inRange(uint64_t x, uint64_t lower, uint64_t upper);
 uint64_t bytesToInt(uint8_t* data, uint8_t len);
 void compareBytes(uint8_t array1[], uint8_t array2[], int nBytes);
-void readFile(const char* filename, uint8_t destination[], int nBytes);
-void writeFile(const char* filename, uint8_t data[], int nBytes);
+bool readFile(const char* filename, uint8_t destination[], int nBytes);
+bool writeFile(const char* filename, const uint8_t data[], int nBytes);
 
 uint8_t inline readBit(uint8_t x, uint8_t n) {
 	return ((x >> n) & 0x01);
 }
 
+uint8_t inline readBit64(uint64_t x, uint8_t n) {
+	return ((x >> n) & 0x01);
+}
+
 void inline setBit(uint8_t* x, uint8_t n) {
 	*x |= (0x01 << n);
 }
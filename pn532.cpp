@@ -1,7 +1,15 @@
 #include "pn532.h"
 
 
-PN532::PN532(interface* _port) : port(_port), debug(false) { }
+//Bits of rfSet
+const uint8_t RF_MUTE_TIMEOUT = 0x01;
+const uint8_t RF_COMMUNICATION_RETRIES = 0x02;
+const uint8_t RF_PASSIVE_ACTIVATION_RETRIES = 0x04;
+
+PN532::PN532(interface* _port) : port(_port), debug(false), lastError(PN532_ERR_NONE), targetSAK(0x00),
+watchdogLimit(2), linkFailures(0), recovering(false), rfSet(0x00) {
+	memset(targetATQA, 0x00, 2);
+}
 
 /*
 
@@ -19,6 +27,127 @@ void PN532::toggleDebug() {
 
 /*
 
+Description: Gets the status of the last command, so callers can decide how to recover from a failure.
+
+Arguments:
+
+Returns: PN532 status code, or PN532_ERR_LINK if the PN532 or interface did not respond
+
+*/
+
+uint8_t PN532::getLastError() {
+	return lastError;
+}
+
+/*
+
+Description: Gets the ATQA and SAK the last detected target answered with.  These come from anticollision, so reading
+			them touches nothing on the card.
+
+Arguments:	atqa - Destination for the ATQA (as sent, 2 bytes)
+			sak - Destination for the SAK
+
+Returns:
+
+*/
+
+void PN532::getTargetInfo(uint8_t atqa[2], uint8_t* sak) {
+	memcpy(atqa, targetATQA, 2);
+	*sak = targetSAK;
+}
+
+/*
+
+Description: Sets how many commands in a row can go unanswered before the device is treated as wedged and recovered.
+
+Arguments:	limit - Number of consecutive failures (0 disables the watchdog)
+
+Returns:
+
+*/
+
+void PN532::setWatchdog(uint8_t limit) {
+	watchdogLimit = limit;
+}
+
+/*
+
+Description: Sends the wake up sequence, in case the PN532 has gone into power down.
+
+Arguments:
+
+Returns: Success boolean - whether the interface passed it on
+
+*/
+
+bool PN532::wakeUp() {
+	uint8_t wakeSequence[5] = {0x55, 0x55, 0x00, 0x00, 0x00};
+	
+	bool sent = port->sendI2C(PN532_I2C, wakeSequence, 5);
+	
+	//Needs a moment before it will accept a command
+	usleep(2000);
+	return sent;
+}
+
+/*
+
+Description: Recovers from a wedged PN532 or interface - does the same as setup (-s), then puts the RF settings back.
+			The frame buffer is preserved so an interrupted command can be sent again, if it doesn't need the target.
+
+Arguments:
+
+Returns: Success boolean
+
+*/
+
+bool PN532::recover() {
+	uint8_t savedFrame[64];
+	bool recovered = false;
+	
+	memcpy(savedFrame, frameBuffer, 64);
+	recovering = true;
+	
+	printf("PN532 is not responding, attempting recovery.\n");
+	
+	if (port->resync()) {
+		wakeUp();
+		recovered = SAMConfig() && restoreRF();
+	}
+	
+	recovering = false;
+	memcpy(frameBuffer, savedFrame, 64);
+	
+	if (recovered) {
+		linkFailures = 0;
+		printf("Recovered.\n");
+	} else {
+		printf("Recovery failed.\n");
+	}
+	
+	return recovered;
+}
+
+/*
+
+Description: Sends the RF settings that were last set back to the PN532.
+
+Arguments:
+
+Returns: Success boolean
+
+*/
+
+bool PN532::restoreRF() {
+	if ((rfSet & RF_MUTE_TIMEOUT) && !setMuteTimeout(rfMuteTimeout)) return false;
+	if ((rfSet & RF_COMMUNICATION_RETRIES) && !setCommunicationRetries(rfCommunicationRetries)) return false;
+	if ((rfSet & RF_PASSIVE_ACTIVATION_RETRIES) && !setPassiveActivationRetries(rfPassiveActivationRetries)) return false;
+	
+	return true;
+}
+
+/*
+
 Description: Gets the firmware version of the PN532.  Mainly used to check communication.
 
 Arguments:
@@ -89,7 +218,11 @@ bool PN532::setMuteTimeout(uint8_t timeout) {
 		return false;
 	}
 
-	return readData(1);
+	if (!readData(1)) return false;
+	
+	rfMuteTimeout = timeout;
+	rfSet |= RF_MUTE_TIMEOUT;
+	return true;
 }
 
 /*
@@ -112,7 +245,11 @@ bool PN532::setCommunicationRetries(uint8_t retries) {
 		return false;
 	}
 
-	return readData(1);
+	if (!readData(1)) return false;
+	
+	rfCommunicationRetries = retries;
+	rfSet |= RF_COMMUNICATION_RETRIES;
+	return true;
 }
 
 /*
@@ -137,7 +274,11 @@ bool PN532::setPassiveActivationRetries(uint8_t retries) {
 		return false;
 	}
 
-	return readData(1);
+	if (!readData(1)) return false;
+	
+	rfPassiveActivationRetries = retries;
+	rfSet |= RF_PASSIVE_ACTIVATION_RETRIES;
+	return true;
 }
 
 /*
@@ -164,6 +305,8 @@ bool PN532::detectMifare1K(uint8_t uid[4]) {
 	if (frameBuffer[1] != 0x01) return false;
 	
 	memcpy(uid, frameBuffer + 7, 4);
+	memcpy(targetATQA, frameBuffer + 3, 2);
+	targetSAK = frameBuffer[5];
 	
 	printf("Found a tag with UID ");
 	printHexBytes(uid, 4);
@@ -196,6 +339,69 @@ bool PN532::select(uint8_t tag) {
 
 /*
 
+Description: Polls the RF field for a MIFARE 1K card using InAutoPoll, returning as soon as one is found or the polls run out.
+			Unlike detectMifare1K this is quiet, so it can be called in a loop.
+
+Arguments:	uid - destination for the UID.
+			pollNr - Number of polls (0x01 - 0xFE, 0xFF is endless)
+			period - Time between polls, in units of 150ms (0x01 - 0x0F)
+
+Returns: Success boolean (false if no card was found)
+
+*/
+
+bool PN532::autoPoll(uint8_t uid[4], uint8_t pollNr, uint8_t period) {
+	
+	frameBuffer[0] = InAutoPoll_CMD;
+	frameBuffer[1] = pollNr;
+	frameBuffer[2] = period;
+	frameBuffer[3] = 0x10; //Mifare card, 106 kbps type A
+	
+	if (!writeCommand(4)) return false;
+	
+	if (!readData(13)) return false;
+	
+	//Number of targets found
+	if (frameBuffer[1] != 0x01) return false;
+	
+	//Target data starts at 4: Tg, ATQA (2), SAK, UID length, UID
+	if (frameBuffer[8] != 0x04) return false;
+	
+	memcpy(uid, frameBuffer + 9, 4);
+	memcpy(targetATQA, frameBuffer + 5, 2);
+	targetSAK = frameBuffer[7];
+	
+	return true;
+}
+
+/*
+
+Description: Runs the Diagnose attention request test, which checks if the current target is still in the field.
+			This is a single short RF exchange, so it is much cheaper than waiting for a read or write to time out.
+			Note that it is sent unencrypted, so any MIFARE authentication is lost and must be redone afterwards.
+
+Arguments:	
+
+Returns: True if the target answered
+
+*/
+
+bool PN532::diagnoseAttention() {
+
+	frameBuffer[0] = Diagnose_CMD;
+	frameBuffer[1] = 0x06; //Attention request test
+	
+	if (!writeCommand(2)) return false;
+	
+	if (!readData(2)) return false;
+	
+	//Don't decode, a missing target is expected here
+	lastError = frameBuffer[1];
+	return (lastError == PN532_ERR_NONE);
+}
+
+/*
+
 Description: Authenticates a sector for a MIFARE Classic 1K card.
 
 Arguments:	block - The block (NOT SECTOR) to authenticate (but it will authenticate the whole sector)
@@ -322,24 +528,23 @@ Returns: Success boolean
 */
 
 bool PN532::checkAck() {
-	static uint8_t ackbuff[7];
-
-	if (!port->receiveI2C(PN532_I2C, ackbuff, 7)) return false;
+	if (!port->receiveI2C(PN532_I2C, ackBuffer, 7)) return false;
 	
 	if (debug) {
-		if (memcmp(ackbuff + 1, PN532_ACK, 6) == 0) {
+		if (memcmp(ackBuffer + 1, PN532_ACK, 6) == 0) {
 			printf("PN532 acknowledged.\n");
 		} else {
 			printf("Incorrect ACK received.\n");
 		}
 	}
 	
-	return (memcmp(ackbuff + 1, PN532_ACK, 6) == 0);
+	return (memcmp(ackBuffer + 1, PN532_ACK, 6) == 0);
 }
 
 /*
 
-Description: Sends a command (TFI to PDN) to the PN532 (the command is in the frameBuffer)
+Description: Sends a command (TFI to PDN) to the PN532 (the command is in the frameBuffer).  If the watchdog finds
+			the device has stopped responding, it is recovered and the command is sent once more.
 
 Arguments:	len - How many bytes are in the command
 
@@ -348,8 +553,39 @@ Returns: Success boolean - If the PN532 ack'd or not
 */
 
 bool PN532::writeCommand(uint8_t len) {
+	if (sendCommand(len)) return true;
+	
+	if (watchdogLimit == 0 || recovering) return false;
+	if (linkFailures < watchdogLimit) return false;
+	
+	if (!recover()) return false;
+	
+	//After a reset the PN532 has no target, so a command for one would only fail; the caller has to start the session
+	//again (RetryPolicy treats this as RETRY_SECTOR).  Anything else can just be sent again.
+	switch (frameBuffer[0]) {
+		case InDataExchange_CMD:
+		case InCommunicateThru_CMD:
+		case InSelect_CMD:
+		case InDeselect_CMD:
+		case InRelease_CMD:
+			lastError = PN532_ERR_RECOVERED;
+			return false;
+		default:
+			return sendCommand(len);
+	}
+}
+
+/*
+
+Description: Frames and sends the command in the frameBuffer, and checks for an ACK.
+
+Arguments:	len - How many bytes are in the command
+
+Returns: Success boolean - If the PN532 ack'd or not
 
-	static uint8_t cmdBuffer[64];
+*/
+
+bool PN532::sendCommand(uint8_t len) {
 
 	cmdBuffer[0] = PREAMBLE;
 	cmdBuffer[1] = START1;
@@ -376,9 +612,15 @@ bool PN532::writeCommand(uint8_t len) {
 		printHexBytes(frameBuffer, len);
 	}
 	
-	if (!port->sendI2C(PN532_I2C, cmdBuffer, len + 8)) return false;
+	lastError = PN532_ERR_LINK;
+	
+	if (!port->sendI2C(PN532_I2C, cmdBuffer, len + 8) || !checkAck()) {
+		linkFailures++;
+		return false;
+	}
 	
-	return checkAck();
+	lastError = PN532_ERR_NONE;
+	return true;
 }
 
 /*
@@ -392,10 +634,12 @@ Returns: Success boolean
 */
 
 bool PN532::readData(uint8_t len) {
-	static uint8_t responseBuffer[64];
-	
 	//Leading 0x01 if ready for I2C!
-	if (!port->receiveI2C(PN532_I2C, responseBuffer, len + 8)) return false;
+	if (!port->receiveI2C(PN532_I2C, responseBuffer, len + 8)) {
+		lastError = PN532_ERR_LINK;
+		linkFailures++;
+		return false;
+	}
 	
 	if (debug) {
 		printf("Received this data from the PN532: ");
@@ -405,9 +649,12 @@ bool PN532::readData(uint8_t len) {
 	if (responseBuffer[6] != 0xD5) {
 		//If this is not the TFI, then its probably an error
 		decodeError(responseBuffer[6]);
+		lastError = PN532_ERR_LINK;
+		linkFailures++;
 		return false;
 	}
 	
+	linkFailures = 0;
 	memcpy(frameBuffer, responseBuffer + 7, len);
 	
 	return true;
@@ -438,7 +685,282 @@ bool PN532::loadMagicMifare(const char* filename, uint8_t keys[0x10][0x06]) {
 	return true;
 }
 
+/*
+
+Description: Reads one of the PN532's internal registers.
+
+Arguments:	reg - Register address
+			value - Destination for the value
+
+Returns: Success boolean
+
+*/
+
+bool PN532::readRegister(uint16_t reg, uint8_t* value) {
+	
+	frameBuffer[0] = ReadRegister_CMD;
+	frameBuffer[1] = reg >> 8;
+	frameBuffer[2] = reg & 0xFF;
+	
+	if (!writeCommand(3)) return false;
+	
+	if (!readData(2)) return false;
+	
+	*value = frameBuffer[1];
+	return true;
+}
+
+/*
+
+Description: Writes one of the PN532's internal registers.
+
+Arguments:	reg - Register address
+			value - Value to write
+
+Returns: Success boolean
+
+*/
+
+bool PN532::writeRegister(uint16_t reg, uint8_t value) {
+	
+	frameBuffer[0] = WriteRegister_CMD;
+	frameBuffer[1] = reg >> 8;
+	frameBuffer[2] = reg & 0xFF;
+	frameBuffer[3] = value;
+	
+	if (!writeCommand(4)) return false;
+	
+	return readData(1);
+}
+
+/*
+
+Description: Sends raw bytes to the target with InCommunicateThru, with no MIFARE handling by the PN532.
+
+Arguments:	data - Bytes to send
+			len - Number of bytes to send (at most 0x20)
+			lastBits - Number of bits to send from the last byte (0 for all 8)
+			response - Destination for the first byte of the response (e.g. a 4 bit ACK)
+
+Returns: Success boolean - whether the target answered
+
+*/
+
+bool PN532::communicateThru(uint8_t* data, uint8_t len, uint8_t lastBits, uint8_t* response) {
+	
+	if (lastBits && !writeRegister(CIU_BitFraming, lastBits)) return false;
+	
+	frameBuffer[0] = InCommunicateThru_CMD;
+	memcpy(frameBuffer + 1, data, len);
+	
+	bool answered = writeCommand(len + 1) && readData(3);
+	
+	//Don't decode, no answer is expected for some frames (e.g. HALT)
+	if (answered) {
+		lastError = frameBuffer[1];
+		answered = (lastError == PN532_ERR_NONE);
+		*response = frameBuffer[2];
+	}
+	
+	if (lastBits && !writeRegister(CIU_BitFraming, 0x00)) return false;
+	
+	return answered;
+}
+
+/*
+
+Description: Turns the CIU's automatic CRC on or off for both directions.
+
+Arguments:	enable - Whether the PN532 should add and check CRCs
+
+Returns: Success boolean
+
+*/
+
+bool PN532::setCRC(bool enable) {
+	uint8_t mode;
+	uint16_t registers[2] = {CIU_TxMode, CIU_RxMode};
+	
+	for (uint8_t i = 0; i < 2; i++) {
+		if (!readRegister(registers[i], &mode)) return false;
+		
+		if (enable) {
+			setBit(&mode, 7);
+		} else {
+			clearBit(&mode, 7);
+		}
+		
+		if (!writeRegister(registers[i], mode)) return false;
+	}
+	
+	return true;
+}
+
+/*
+
+Description: Appends the ISO/IEC 14443-3 type A CRC (poly 0x8408, initial 0x6363) to a frame.
+
+Arguments:	data - The frame, with 2 spare bytes at the end
+			len - Length of the frame without the CRC
+
+Returns: 
+
+*/
+
+static void appendCRCA(uint8_t* data, uint8_t len) {
+	uint16_t crc = 0x6363;
+	uint8_t bt;
+	
+	for (uint8_t i = 0; i < len; i++) {
+		bt = data[i] ^ (crc & 0xFF);
+		bt ^= bt << 4;
+		crc = (crc >> 8) ^ ((uint16_t)bt << 8) ^ ((uint16_t)bt << 3) ^ (bt >> 4);
+	}
+	
+	data[len] = crc & 0xFF;
+	data[len + 1] = crc >> 8;
+}
+
+/*
+
+Description: Opens the backdoor on a gen1a magic card (HALT, then 0x40 as 7 bits, then 0x43).  While it is open, every
+			block including block zero and the trailers can be written without authenticating.
+
+Arguments:	
+
+Returns: Success boolean - false if the card is not gen1a
+
+*/
+
+bool PN532::gen1aUnlock() {
+	uint8_t halt[4] = {0x50, 0x00};
+	uint8_t unlock1 = 0x40;
+	uint8_t unlock2 = 0x43;
+	uint8_t response;
+	
+	if (!setCRC(false)) return false;
+	
+	//The card doesn't answer a HALT
+	appendCRCA(halt, 2);
+	communicateThru(halt, 4, 0, &response);
+	
+	if (!communicateThru(&unlock1, 1, 7, &response) || (response & 0x0F) != MIFARE_ACK) {
+		gen1aFinish();
+		return false;
+	}
+	
+	if (!communicateThru(&unlock2, 1, 0, &response) || (response & 0x0F) != MIFARE_ACK) {
+		gen1aFinish();
+		return false;
+	}
+	
+	return true;
+}
+
+/*
+
+Description: Checks for a magic backdoor without writing anything.  Gen1a cards ACK both unlock commands; UFUID cards
+			(before they are locked) and some other one-time cards only ACK the first.  The card is selected again afterwards.
+
+Arguments:	
+
+Returns: Number of unlock commands that were ACK'd (0, 1 or 2)
+
+*/
+
+uint8_t PN532::probeBackdoor() {
+	uint8_t halt[4] = {0x50, 0x00};
+	uint8_t unlock1 = 0x40;
+	uint8_t unlock2 = 0x43;
+	uint8_t response;
+	uint8_t acked = 0;
+	
+	if (!setCRC(false)) return 0;
+	
+	appendCRCA(halt, 2);
+	communicateThru(halt, 4, 0, &response);
+	
+	if (communicateThru(&unlock1, 1, 7, &response) && (response & 0x0F) == MIFARE_ACK) {
+		acked++;
+		if (communicateThru(&unlock2, 1, 0, &response) && (response & 0x0F) == MIFARE_ACK) {
+			acked++;
+		}
+	}
+	
+	gen1aFinish();
+	return acked;
+}
+
+/*
+
+Description: Writes a block through the gen1a backdoor (gen1aUnlock must have been called).
+
+Arguments:	block - Number of the block to be written
+			data - The data to write
+
+Returns: Success boolean
+
+*/
+
+bool PN532::gen1aWriteBlock(uint8_t block, uint8_t data[16]) {
+	uint8_t command[4] = {0xA0, block};
+	uint8_t payload[18];
+	uint8_t response;
+	
+	appendCRCA(command, 2);
+	if (!communicateThru(command, 4, 0, &response) || (response & 0x0F) != MIFARE_ACK) return false;
+	
+	memcpy(payload, data, 16);
+	appendCRCA(payload, 16);
+	if (!communicateThru(payload, 18, 0, &response) || (response & 0x0F) != MIFARE_ACK) return false;
+	
+	return true;
+}
+
+/*
+
+Description: Puts the PN532 back to normal after using the gen1a backdoor, and selects the card again (its UID may have changed).
+
+Arguments:	
+
+Returns: Success boolean
+
+*/
+
+bool PN532::gen1aFinish() {
+	uint8_t uid[4];
+	
+	if (!setCRC(true)) return false;
+	
+	return autoPoll(uid, 0x01, 0x01);
+}
+
+/*
+
+Description: Writes all 64 blocks of a gen1a magic card through the backdoor, trailers included, with no authentication.
+
+Arguments:	data - The full card image
+
+Returns: Success boolean
+
+*/
+
+bool PN532::writeGen1a(uint8_t data[0x40][0x10]) {
+	if (!gen1aUnlock()) return false;
+	
+	for (uint8_t block = 0; block < 0x40; block++) {
+		if (!gen1aWriteBlock(block, data[block])) {
+			gen1aFinish();
+			return false;
+		}
+	}
+	
+	return gen1aFinish();
+}
+
 bool PN532::decodeError(uint8_t error) {
+	lastError = error;
+	
 	if (error == 0x00) return true;
 
 	printf("Error %02x:", error);
@@ -53,6 +53,25 @@ const uint8_t TgGetInitiatorCommand_CMD = 0x88;
 const uint8_t TgResponseToInitiator_CMD = 0x90;
 const uint8_t TgGetTargetStatus_CMD = 0x8A;
 
+//Status codes (see decodeError).  Link is not a PN532 code; it marks a missing ACK or response frame.
+const uint8_t PN532_ERR_NONE = 0x00;
+const uint8_t PN532_ERR_TIMEOUT = 0x01;
+const uint8_t PN532_ERR_CRC = 0x02;
+const uint8_t PN532_ERR_PARITY = 0x03;
+const uint8_t PN532_ERR_FRAMING = 0x05;
+const uint8_t PN532_ERR_FORMAT = 0x13;
+const uint8_t PN532_ERR_AUTH = 0x14;
+const uint8_t PN532_ERR_RECOVERED = 0xFE;	//Not from the PN532: it was reset mid-session, so the target has to be selected and authenticated again
+const uint8_t PN532_ERR_LINK = 0xFF;
+
+//CIU registers
+const uint16_t CIU_TxMode = 0x6302;
+const uint16_t CIU_RxMode = 0x6303;
+const uint16_t CIU_BitFraming = 0x633D;
+
+//MIFARE 4 bit ACK
+const uint8_t MIFARE_ACK = 0x0A;
+
 const uint8_t PN532_ACK[6] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
 const uint8_t PN532_NACK[6] = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
 
@@ -84,6 +103,12 @@ class PN532 {
 		PN532(interface* _port);
 		
 		void toggleDebug();
+		uint8_t getLastError();
+		void getTargetInfo(uint8_t atqa[2], uint8_t* sak);
+		void setWatchdog(uint8_t limit);
+		
+		bool wakeUp();
+		bool recover();
 		
 		void getFirmwareVersion();
 		bool SAMConfig();
@@ -95,6 +120,9 @@ class PN532 {
 		bool detectMifare1K(uint8_t uid[4]);
 		bool select(uint8_t tag);
 		
+		bool autoPoll(uint8_t uid[4], uint8_t pollNr, uint8_t period);
+		bool diagnoseAttention();
+		
 		bool MifareClassic_AuthenticateBlock(uint8_t block, uint8_t uid[4], bool keyType, uint8_t key[6]);
 		bool MifareClassic_ReadBlock(uint8_t block, uint8_t* destination);		
 		bool MifareClassic_WriteBlock(uint8_t block, uint8_t data[16]);
@@ -106,16 +134,50 @@ class PN532 {
 		
 		bool loadMagicMifare(const char* filename, uint8_t keys[0x10][0x06]);
 		
+		bool readRegister(uint16_t reg, uint8_t* value);
+		bool writeRegister(uint16_t reg, uint8_t value);
+		bool communicateThru(uint8_t* data, uint8_t len, uint8_t lastBits, uint8_t* response);
+		
+		bool gen1aUnlock();
+		uint8_t probeBackdoor();
+		bool gen1aWriteBlock(uint8_t block, uint8_t data[16]);
+		bool gen1aFinish();
+		bool writeGen1a(uint8_t data[0x40][0x10]);
+		
 	private:
 		interface* port;
 		uint8_t frameBuffer[64];
+		
+		//Raw frames on the way out and in, kept per object so separate readers don't share them
+		uint8_t cmdBuffer[64];
+		uint8_t responseBuffer[64];
+		uint8_t ackBuffer[7];
 		bool debug;
+		uint8_t lastError;
+		
+		//What the last detected target answered with during anticollision
+		uint8_t targetATQA[2];
+		uint8_t targetSAK;
+		
+		//Watchdog state
+		uint8_t watchdogLimit;
+		uint8_t linkFailures;
+		bool recovering;
+		
+		//RF settings to restore after recovery
+		uint8_t rfSet;
+		uint8_t rfMuteTimeout;
+		uint8_t rfCommunicationRetries;
+		uint8_t rfPassiveActivationRetries;
 		
 		bool checkAck();
 		
 		bool writeCommand(uint8_t len);
+		bool sendCommand(uint8_t len);
+		bool restoreRF();
 		bool readData(uint8_t len);
 		bool decodeError(uint8_t error);
+		bool setCRC(bool enable);
 
 
 
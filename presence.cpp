@@ -0,0 +1,78 @@
+#include "presence.h"
+
+PresenceMonitor::PresenceMonitor(PN532* _nfc) : nfc(_nfc), present(false) {
+	memset(UID, 0x00, 4);
+}
+
+/*
+
+Description: Checks for a change in the figure on the portal.  When no figure is present, this polls the field once
+			(about 150ms); when one is present, it sends a single attention request.
+
+Arguments:	
+
+Returns: Which event occurred, if any
+
+*/
+
+PresenceEvent PresenceMonitor::poll() {
+	if (!present) {
+		if (!nfc->autoPoll(UID, 0x01, 0x01)) return NO_CHANGE;
+		
+		present = true;
+		return TAG_ARRIVED;
+	}
+	
+	if (stillPresent()) return NO_CHANGE;
+	
+	return TAG_REMOVED;
+}
+
+/*
+
+Description: Heartbeat for long operations - checks that the figure found by poll() is still on the portal.
+			This drops any MIFARE authentication, so call it between sectors rather than between blocks.
+
+Arguments:	
+
+Returns: True if the figure is still present
+
+*/
+
+bool PresenceMonitor::stillPresent() {
+	if (!present) return false;
+	
+	if (!nfc->diagnoseAttention()) {
+		present = false;
+	}
+	
+	return present;
+}
+
+/*
+
+Description: Returns the last known state without talking to the PN532.
+
+Arguments:	
+
+Returns: True if a figure was present at the last check
+
+*/
+
+bool PresenceMonitor::isPresent() {
+	return present;
+}
+
+/*
+
+Description: Copies the UID of the figure that was last found into a byte array.
+
+Arguments:	destination - destination for the UID
+
+Returns: 
+
+*/
+
+void PresenceMonitor::getUID(uint8_t destination[4]) {
+	memcpy(destination, UID, 4);
+}
@@ -0,0 +1,41 @@
+#ifndef _PRESENCE_H_
+#define _PRESENCE_H_
+
+#include <stdint.h>
+#include <memory.h>
+#include <stdio.h>
+#include "pn532.h"
+
+class PN532;
+
+enum PresenceEvent {
+	NO_CHANGE,
+	TAG_ARRIVED,
+	TAG_REMOVED
+};
+
+/*
+
+Tracks whether a figure is on the portal.  Arrival is found with InAutoPoll, and once a figure is present
+it is checked with the Diagnose attention test, which answers within one RF timeout instead of running
+through a whole read/write command's retries.
+
+*/
+
+class PresenceMonitor {
+	public:
+		PresenceMonitor(PN532* _nfc);
+		
+		PresenceEvent poll();
+		bool stillPresent();
+		
+		bool isPresent();
+		void getUID(uint8_t destination[4]);
+		
+	private:
+		PN532* nfc;
+		bool present;
+		uint8_t UID[4];
+};
+
+#endif
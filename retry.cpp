@@ -0,0 +1,62 @@
+#include "retry.h"
+#include "pn532.h"
+
+RetryPolicy::RetryPolicy() : maxAttempts(4), baseDelay(2), maxDelay(20) { }
+
+RetryPolicy::RetryPolicy(uint8_t _maxAttempts, uint16_t _baseDelay, uint16_t _maxDelay) : 
+maxAttempts(_maxAttempts), baseDelay(_baseDelay), maxDelay(_maxDelay) { }
+
+/*
+
+Description: Works out what to do about a failed command.
+
+Arguments:	error - The status code from PN532::getLastError
+
+Returns: The recovery action
+
+*/
+
+RetryAction RetryPolicy::classify(uint8_t error) {
+	switch (error) {
+		case PN532_ERR_NONE:
+			return RETRY_NONE;
+			
+		//Marginal RF, the card is still in the same state so the block can just be sent again
+		case PN532_ERR_TIMEOUT:
+		case PN532_ERR_CRC:
+		case PN532_ERR_PARITY:
+		case PN532_ERR_LINK:
+			return RETRY_BLOCK;
+		
+		//The card has dropped out of its authenticated state
+		case PN532_ERR_FRAMING:
+		case PN532_ERR_FORMAT:
+		case PN532_ERR_AUTH:
+		//The PN532 was reset and has lost the target
+		case PN532_ERR_RECOVERED:
+			return RETRY_SECTOR;
+			
+		default:
+			return RETRY_ABORT;
+	}
+}
+
+/*
+
+Description: Waits before the next attempt.
+
+Arguments:	attempt - How many attempts have failed so far, minus one
+
+Returns: False if there are no attempts left (without waiting)
+
+*/
+
+bool RetryPolicy::backoff(uint8_t attempt) {
+	if (attempt + 1 >= maxAttempts) return false;
+	
+	uint32_t delay = (attempt < 16) ? ((uint32_t)baseDelay << attempt) : maxDelay;
+	if (delay > maxDelay) delay = maxDelay;
+	
+	usleep(delay * 1000);
+	return true;
+}
@@ -0,0 +1,35 @@
+#ifndef _RETRY_H_
+#define _RETRY_H_
+
+#include <stdint.h>
+#include <unistd.h>
+
+enum RetryAction {
+	RETRY_NONE,		//Command succeeded
+	RETRY_BLOCK,	//Repeat the same block command
+	RETRY_SECTOR,	//Select the card again and re-authenticate the sector, then repeat the block
+	RETRY_ABORT		//Not recoverable
+};
+
+/*
+
+Decides how a failed card command should be recovered, based on the PN532 status code.
+Delays between attempts grow exponentially from baseDelay, capped at maxDelay (both in ms).
+
+*/
+
+class RetryPolicy {
+	public:
+		RetryPolicy();
+		RetryPolicy(uint8_t _maxAttempts, uint16_t _baseDelay, uint16_t _maxDelay);
+		
+		RetryAction classify(uint8_t error);
+		bool backoff(uint8_t attempt);
+		
+	private:
+		uint8_t maxAttempts;
+		uint16_t baseDelay;
+		uint16_t maxDelay;
+};
+
+#endif
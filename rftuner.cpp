@@ -0,0 +1,151 @@
+#include "rftuner.h"
+#include "pn532.h"
+
+//Block commands per adjustment
+const uint8_t tunerWindow = 0x10;
+
+//Windows to leave the settings alone after undoing a step
+const uint8_t tunerHold = 0x04;
+
+//Step codes for lastStep
+const int8_t STEP_NONE = 0;
+const int8_t STEP_TIMEOUT_DOWN = 1;
+const int8_t STEP_RETRIES_DOWN = 2;
+
+RFTuner::RFTuner(PN532* _nfc) : RFTuner(_nfc, defaultRFBounds) { }
+
+RFTuner::RFTuner(PN532* _nfc, RFBounds _bounds) : nfc(_nfc), bounds(_bounds), 
+muteTimeout(_bounds.maxMuteTimeout), communicationRetries(_bounds.minCommunicationRetries),
+samples(0), failures(0), windowMicros(0), lastCost(0), lastStep(STEP_NONE), hold(0),
+totalBlocks(0), totalFailures(0), totalMicros(0) { }
+
+/*
+
+Description: Puts the PN532 into the starting state: longest timeout, fewest retries.
+
+Arguments:	
+
+Returns: Success boolean
+
+*/
+
+bool RFTuner::begin() {
+	if (!nfc->setPassiveActivationRetries(bounds.passiveActivationRetries)) return false;
+	return apply();
+}
+
+/*
+
+Description: Records the outcome of one block command attempt (read, write or authentication).
+
+Arguments:	success - Whether the attempt worked
+			micros - How long it took, including any PN532 retries
+
+Returns: 
+
+*/
+
+void RFTuner::record(bool success, uint32_t micros) {
+	samples++;
+	windowMicros += micros;
+	totalBlocks++;
+	totalMicros += micros;
+	
+	if (!success) {
+		failures++;
+		totalFailures++;
+	}
+	
+	if (samples >= tunerWindow) {
+		adjust();
+	}
+}
+
+/*
+
+Description: Prints the running totals.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void RFTuner::printStats() {
+	printf("RF: %u block commands, %u failed, mean %u us.  Timeout code %02X, %u retries.\n", totalBlocks, totalFailures, 
+	(uint32_t)(totalBlocks ? totalMicros / totalBlocks : 0), muteTimeout, communicationRetries);
+}
+
+/*
+
+Description: Picks new settings at the end of a window.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void RFTuner::adjust() {
+	//Mean time per successful block.  A window with no successes costs all of its time.
+	uint32_t cost = windowMicros / ((samples > failures) ? (samples - failures) : 1);
+	bool flaky = (failures * 8 > samples);
+	uint8_t oldTimeout = muteTimeout;
+	uint8_t oldRetries = communicationRetries;
+	
+	if (lastStep != STEP_NONE && (flaky || cost > lastCost)) {
+		//The last step down made things worse
+		if (lastStep == STEP_TIMEOUT_DOWN) muteTimeout++;
+		if (lastStep == STEP_RETRIES_DOWN) communicationRetries++;
+		lastStep = STEP_NONE;
+		hold = tunerHold;
+	} else if (flaky) {
+		//Let the PN532 retry in the field, rather than the host restarting the command
+		if (communicationRetries < bounds.maxCommunicationRetries) {
+			communicationRetries++;
+		} else if (muteTimeout < bounds.maxMuteTimeout) {
+			muteTimeout++;
+		}
+		lastStep = STEP_NONE;
+	} else if (hold) {
+		hold--;
+		lastStep = STEP_NONE;
+	} else if (failures == 0) {
+		//The card is answering well, try shorter waits
+		if (muteTimeout > bounds.minMuteTimeout) {
+			muteTimeout--;
+			lastStep = STEP_TIMEOUT_DOWN;
+		} else if (communicationRetries > bounds.minCommunicationRetries) {
+			communicationRetries--;
+			lastStep = STEP_RETRIES_DOWN;
+		} else {
+			lastStep = STEP_NONE;
+		}
+	} else {
+		lastStep = STEP_NONE;
+	}
+	
+	lastCost = cost;
+	samples = 0;
+	failures = 0;
+	windowMicros = 0;
+	
+	if (muteTimeout != oldTimeout || communicationRetries != oldRetries) {
+		apply();
+	}
+}
+
+/*
+
+Description: Sends the current settings to the PN532.
+
+Arguments:	
+
+Returns: Success boolean
+
+*/
+
+bool RFTuner::apply() {
+	if (!nfc->setMuteTimeout(muteTimeout)) return false;
+	return nfc->setCommunicationRetries(communicationRetries);
+}
@@ -0,0 +1,70 @@
+#ifndef _RFTUNER_H_
+#define _RFTUNER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+class PN532;
+
+/*
+
+Limits for the RF settings.  Timeouts are PN532 codes (0x07 = 6.4ms, each step doubles, 0x0A = 51.2ms),
+retries are retries, not attempts.
+
+*/
+
+struct RFBounds {
+	uint8_t minMuteTimeout;
+	uint8_t maxMuteTimeout;
+	uint8_t minCommunicationRetries;
+	uint8_t maxCommunicationRetries;
+	uint8_t passiveActivationRetries;
+};
+
+const RFBounds defaultRFBounds = {0x07, 0x0B, 0x00, 0x05, 0x10};
+
+/*
+
+Adjusts the PN532 RF settings from live block statistics, aiming for the lowest mean time per successful block.
+Clean windows step the timeout down (and then the retries), windows with failures add RF retries before
+lengthening the timeout.  A step down that makes the window cost worse is undone and held for a while.
+
+*/
+
+class RFTuner {
+	public:
+		RFTuner(PN532* _nfc);
+		RFTuner(PN532* _nfc, RFBounds _bounds);
+		
+		bool begin();
+		void record(bool success, uint32_t micros);
+		
+		void printStats();
+		
+	private:
+		PN532* nfc;
+		RFBounds bounds;
+		
+		uint8_t muteTimeout;
+		uint8_t communicationRetries;
+		
+		//Current window
+		uint8_t samples;
+		uint8_t failures;
+		uint32_t windowMicros;
+		
+		//Previous window and change, to undo steps that didn't help
+		uint32_t lastCost;
+		int8_t lastStep;
+		uint8_t hold;
+		
+		//Totals for printStats
+		uint32_t totalBlocks;
+		uint32_t totalFailures;
+		uint64_t totalMicros;
+		
+		void adjust();
+		bool apply();
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "scheduler.h"
+#include "mifare.h"
+#include <chrono>
+
+WriteScheduler::WriteScheduler() : budgetMillis(0), startMicros(0), writeMicros(12000), authMicros(6000) { }
+
+/*
+
+Description: Sets how long a write is allowed to take, e.g. how long a figure is expected to stay on the portal.
+
+Arguments:	_budgetMillis - Budget in ms, counted from the start of updateData (0 for no limit)
+
+Returns: 
+
+*/
+
+void WriteScheduler::setBudget(uint32_t _budgetMillis) {
+	budgetMillis = _budgetMillis;
+}
+
+/*
+
+Description: Works out the order to write the altered blocks in.  Block zero and trailers are never included.
+
+Arguments:	order - Destination for the block numbers
+			priority - Priority of each block (lower is written first)
+			altered - Which blocks need writing
+
+Returns: Number of blocks to write
+
+*/
+
+uint8_t WriteScheduler::plan(uint8_t order[0x40], uint8_t priority[0x40], bool altered[0x40]) {
+	uint8_t count = 0;
+	
+	//Insertion sort, stable so blocks stay ascending within a priority
+	for (uint8_t block = 0x01; block < 0x40; block++) {
+		if (isTrailerBlock(block) || !altered[block]) continue;
+		
+		uint8_t i = count;
+		while (i > 0 && priority[order[i - 1]] > priority[block]) {
+			order[i] = order[i - 1];
+			i--;
+		}
+		order[i] = block;
+		count++;
+	}
+	
+	return count;
+}
+
+/*
+
+Description: Marks the start of a write, for the budget.
+
+Arguments:	
+
+Returns: 
+
+*/
+
+void WriteScheduler::start() {
+	startMicros = nowMicros();
+}
+
+/*
+
+Description: Estimates whether the remaining blocks can be written within the budget.
+
+Arguments:	order - The remaining blocks, in the order they will be written
+			remaining - How many blocks are left
+			currentSector - The sector that is currently authenticated (0xFF for none)
+
+Returns: True if they are expected to finish in time (always true without a budget)
+
+*/
+
+bool WriteScheduler::fits(uint8_t order[], uint8_t remaining, uint8_t currentSector) {
+	if (budgetMillis == 0) return true;
+	
+	uint64_t estimate = 0;
+	uint8_t sector = currentSector;
+	
+	for (uint8_t i = 0; i < remaining; i++) {
+		if (blockToSector(order[i]) != sector) {
+			sector = blockToSector(order[i]);
+			estimate += authMicros;
+		}
+		estimate += writeMicros;
+	}
+	
+	return (nowMicros() - startMicros + estimate <= (uint64_t)budgetMillis * 1000);
+}
+
+/*
+
+Description: Adds a block write time (including retries) to the moving average.
+
+Arguments:	micros - How long the write took
+
+Returns: 
+
+*/
+
+void WriteScheduler::recordWrite(uint32_t micros) {
+	writeMicros = (3 * writeMicros + micros) / 4;
+}
+
+/*
+
+Description: Adds a sector authentication time (including retries) to the moving average.
+
+Arguments:	micros - How long the authentication took
+
+Returns: 
+
+*/
+
+void WriteScheduler::recordAuth(uint32_t micros) {
+	authMicros = (3 * authMicros + micros) / 4;
+}
+
+uint64_t WriteScheduler::nowMicros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
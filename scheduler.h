@@ -0,0 +1,43 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+#include <memory.h>
+
+/*
+
+Orders the blocks for MIFARE_1K::updateData and keeps track of how long writes take.
+Blocks are written lowest priority value first (ascending block order within a priority), so the block
+that makes a save valid can be left until everything it depends on has landed.
+
+With a budget set, the scheduler estimates whether the remaining blocks will finish in time from the measured
+write and authentication latencies, so a write that can't finish is stopped before its commit block.
+
+*/
+
+class WriteScheduler {
+	public:
+		WriteScheduler();
+		
+		void setBudget(uint32_t _budgetMillis);
+		
+		uint8_t plan(uint8_t order[0x40], uint8_t priority[0x40], bool altered[0x40]);
+		
+		void start();
+		bool fits(uint8_t order[], uint8_t remaining, uint8_t currentSector);
+		
+		void recordWrite(uint32_t micros);
+		void recordAuth(uint32_t micros);
+		
+	private:
+		uint32_t budgetMillis;
+		uint64_t startMicros;
+		
+		//Moving averages
+		uint32_t writeMicros;
+		uint32_t authMicros;
+		
+		uint64_t nowMicros();
+};
+
+#endif
@@ -1,11 +1,11 @@
 #include "skylander.h"
 
-CRC keycrc(0x30, 0x42f0e1eba9ea3693, 0x9ae903260cc4);  
-CRC checkcrc(0x10, 0x1021, 0xffff);
+const CRC keycrc(0x30, 0x42f0e1eba9ea3693, 0x9ae903260cc4);  
+const CRC checkcrc(0x10, 0x1021, 0xffff);
 
 uint8_t sectorZero[11] = {0x81, 0x01, 0x0f, 0xc4, 0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x15};
 
-uint32_t minXPforLevel[21] = {	
+const uint32_t minXPforLevel[21] = {	
 								0,
 								0,
 								1000,
@@ -34,10 +34,10 @@ struct dataInfo {
 	uint8_t size;
 };
 
-dataInfo charCode = {0x10, 0x02};
-dataInfo typeCode = {0x1C, 0x02};
+const dataInfo charCode = {0x10, 0x02};
+const dataInfo typeCode = {0x1C, 0x02};
 
-dataInfo crc[5] = {
+const dataInfo crc[5] = {
 					{0x1E, 0x02},
 					{0x0E, 0x02},
 					{0x0C, 0x02},
@@ -45,52 +45,90 @@ dataInfo crc[5] = {
 					{0x90, 0x02}	
 				};	
 
-dataInfo xp[3] = {
+//What each checksum covers, in the order it goes through the CRC.  Blocks are relative to the area header, except
+//for type 0, which is blocks 0x00-0x01 for both areas.  Sorted by block, so one pass over an area feeds every type.
+struct checksumSpan {
+	uint8_t type;
+	uint8_t block;
+	uint8_t from;
+	uint8_t to;
+};
+
+const checksumSpan checksumSpans[] = {
+					{0, 0x00, 0x00, 0x10},
+					{0, 0x01, 0x00, 0x0E},
+					{1, 0x00, 0x00, 0x0E},
+					{2, 0x01, 0x00, 0x10},
+					{2, 0x02, 0x00, 0x10},
+					{2, 0x04, 0x00, 0x10},
+					{3, 0x05, 0x00, 0x10},
+					{3, 0x06, 0x00, 0x10},
+					{3, 0x08, 0x00, 0x10},
+					{4, 0x09, 0x02, 0x10},
+					{4, 0x0A, 0x00, 0x10},
+					{4, 0x0C, 0x00, 0x10},
+					{4, 0x0D, 0x00, 0x10}
+				};
+
+const uint8_t nChecksumSpans = sizeof(checksumSpans) / sizeof(checksumSpan);
+
+//Fixed bytes in place of data: type 1 ends with 05 00 where its own checksum goes, type 4 starts with 06 01, and
+//type 3 is padded out with zeros
+const uint8_t checksumTail1[2] = {0x05, 0x00};
+const uint8_t checksumHead4[2] = {0x06, 0x01};
+const uint16_t checksumZeros3 = 0xE0;
+
+const dataInfo xp[3] = {
 					{0x00, 0x03},
 					{0x93, 0x02},
 					{0x98, 0x03}
 				};	
 
-dataInfo gold = {0x03, 0x02};
+const dataInfo gold = {0x03, 0x02};
 
-dataInfo playtime = {0x05, 0x02};
+const dataInfo playtime = {0x05, 0x02};
 
-dataInfo save = {0x09, 0x01};
+const dataInfo save = {0x09, 0x01};
 
-dataInfo upgrades = {0x10, 0x02};
+const dataInfo upgrades = {0x10, 0x02};
 
-dataInfo platforms = {0x13, 0x01};
+const dataInfo platforms = {0x13, 0x01};
 
-dataInfo hats[4] = {
+const dataInfo hats[4] = {
 					{0x14, 0x01},
 					{0x95, 0x01},
 					{0x9C, 0x01},
 					{0x9E, 0x01}
 				};	
 
-dataInfo ownership = {0x18, 0x08};
+const dataInfo ownership = {0x18, 0x08};
 
-dataInfo name[2] = {
+const dataInfo name[2] = {
 					{0x20, 0x10},
 					{0x40, 0x10},
 				};	
 				
-dataInfo history[2] = {
+const dataInfo history[2] = {
 					{0x50, 0x06},
 					{0x60, 0x06},
 				};	
 
-Skylander::Skylander(const char* filename, PN532* _nfc) : MIFARE_1K(filename, _nfc), encrypted(true) {
+Skylander::Skylander(const char* filename, PN532* _nfc) : MIFARE_1K(filename, _nfc), encrypted(true), decryptedMask(0), modifiedMask(0) {
 	getEncryption();
 	dataToParams();
 }
 
-Skylander::Skylander(PN532* _nfc) : MIFARE_1K(_nfc), encrypted(true) {
+Skylander::Skylander(const CardImage& image, PN532* _nfc) : MIFARE_1K(image, _nfc), encrypted(true), decryptedMask(0), modifiedMask(0) {
+	getEncryption();
+}
+
+Skylander::Skylander(PN532* _nfc) : MIFARE_1K(_nfc), encrypted(true), decryptedMask(0), modifiedMask(0) {
 	calcKeysA();
 	readSectorZero();
 }
 
-Skylander::Skylander(PN532* _nfc, bool _isMagic) : MIFARE_1K(_nfc), encrypted(false) {
+Skylander::Skylander(PN532* _nfc, bool _isMagic) : MIFARE_1K(_nfc), encrypted(false), decryptedMask(~0ULL), modifiedMask(~0ULL) {
+	memset(seed, 0x00, 0x20);
 	if (_isMagic) {
 		magic();
 		uint8_t key[6];
@@ -113,29 +151,45 @@ void Skylander::readSectorZero() {
 
 bool Skylander::loadBackup(const char* filename) {
 	uint8_t buffer[0x400];
-	readFile(filename, buffer, 0x400);
+	
+	//The magic paths write every trailer and block zero from this, so a missing or short file must never get that far
+	if (!readFile(filename, buffer, 0x400)) {
+		printf("Couldn't read a full backup from %s\n", filename);
+		return false;
+	}
+	
+	if (isGen1a) {
+		//Everything, trailers and block zero included, goes through the backdoor
+		memcpy(data, buffer, 0x400);
+		dataToParams();
+		return writeAll();
+	}
 
 	if (isMagic) {
+		//Keys the card has now (set up by prepare)
 		calcKeysA();
-		changeUID(buffer);
 		
-		uint8_t newKey[0x06];
+		//Same trailers as prepare would leave, but with the keys for the new UID
+		uint8_t image[0x40][0x10];
+		memcpy(image, buffer, 0x400);
+		
 		for (uint8_t sector = 0; sector < 0x10; sector++) {
-			calcKeyA(newKey, sector);
-			setKeyA(sector, newKey);
+			uint8_t block = sectorToBlock(sector);
+			
+			calcKeyA(image[block], sector, image[0]);
+			memcpy(image[block] + 0x06, data[block] + 0x06, 0x04);
+			memset(image[block] + 0x0A, 0x00, 0x06);
 		}
 		
-		uint8_t newBlockZero[0x0B];
-		memcpy(newBlockZero, buffer + 0x05, 0x0B);
-		changeBlockZero(newBlockZero);
-	
-	
-		flag(0x01);
-		flag(0x02);
+		return provision(image);
 	}
 
 
 	if (memcmp(buffer, UID, 0x04)) return false;
+	
+	//Reading is cheaper than writing, and a restore usually only differs in a few blocks
+	if (!isMagic && !haveCardImage) read();
+	
 	memcpy(data, buffer, 0x400);
 	
 	for (uint8_t block = 0x04; block < 0x40; block++) {
@@ -151,11 +205,11 @@ bool Skylander::loadBackup(const char* filename) {
 void Skylander::printInfo() {
 	
 	uint16_t CharCode = getCharCode();
-	std::string CharName = getCharName(CharCode);
+	const char* CharName = getCharName(CharCode);
 	uint16_t TypeCode = getTypeCode();
 	
 	printf("Character code: %04x\n", CharCode);
-	printf("Character: %s\n", CharName.c_str());
+	printf("Character: %s\n", CharName);
 	printf("Type Code: %04x\n", TypeCode);
 	
 	if (encrypted) {
@@ -190,7 +244,7 @@ void Skylander::printInfo() {
 	printf("Last Played: %02i/%02i/%04i %02i:%02i, First Played: %02i/%02i/%04i %02i:%02i\n",
 	LastPlayed[2], LastPlayed[3], YearLast, LastPlayed[1], LastPlayed[0], FirstPlayed[2], FirstPlayed[3], YearFirst, FirstPlayed[1], FirstPlayed[0]);
 
-	printf("Name: %s\n", Name.c_str());
+	printf("Name: %s\n", Name);
 
 
 
@@ -212,43 +266,194 @@ void Skylander::setCharacter(uint16_t charCode, uint16_t typeCode) {
 
 
 
+/*
+
+Description: Switches the figure to its decrypted view.  Nothing is decrypted yet; each block is decrypted the first
+			time plain() or edit() touches it, and the ciphertext is kept so untouched blocks cost nothing to encrypt again.
+
+Arguments:	
+
+Returns: False if it was already decrypted
+
+*/
+
 bool Skylander::decrypt() {
 
 	if (!encrypted) return false;
 
-	for (uint8_t block = 0; block < 0x40; block++) {
-		if (shouldEncryptBlock(block)) {
-			decryptBlock(block);
-		}
-	}
+	memcpy(cipher, data, 0x400);
+	memcpy(seed, data[0], 0x20);
+	decryptedMask = modifiedMask = 0;
 	
 	encrypted = false;
 	getArea();
 	return true;
 }
 
+/*
+
+Description: Switches back to the encrypted data.  Only blocks changed through edit() go through AES; blocks that were
+			only read get their saved ciphertext back.
+
+Arguments:	
+
+Returns: False if it was already encrypted
+
+*/
+
 bool Skylander::encrypt() {
 
 	if (encrypted) return false;
 	
+	reseed();
+	
 	for (uint8_t block = 0; block < 0x40; block++) {
-		if (shouldEncryptBlock(block)) {
-			encryptBlock(block);
+		if (shouldEncryptBlock(block) && readBit64(decryptedMask, block) && !readBit64(modifiedMask, block)) {
+			memcpy(data[block], cipher[block], 0x10);
 		}
 	}
 	
+	cryptBlocks(modifiedMask, true);
+	decryptedMask = modifiedMask = 0;
+	
 	encrypted = true;
 	return true;
 }
 
+/*
+
+Description: Gets a pointer to decrypted data, decrypting the blocks it covers if they haven't been yet.
+			Offsets can run past the end of the block, as the save areas are laid out contiguously.
+
+Arguments:	block - First block
+			offset - Offset from the start of that block
+			len - Number of bytes that will be read
+
+Returns: Pointer into data
+
+*/
+
+uint8_t* Skylander::plain(uint8_t block, uint16_t offset, uint16_t len) {
+	if (!encrypted) {
+		reseed();
+		
+		uint8_t last = block + (offset + len - 1) / 0x10;
+		
+		for (uint8_t i = block + offset / 0x10; i <= last; i++) {
+			if (shouldEncryptBlock(i) && !readBit64(decryptedMask, i)) {
+				decryptBlock(i);
+				decryptedMask |= (1ULL << i);
+			}
+		}
+	}
+	
+	return data[block] + offset;
+}
+
+/*
+
+Description: Same as plain(), but marks the blocks as modified so encrypt() knows to encrypt them again.
+
+Arguments:	block - First block
+			offset - Offset from the start of that block
+			len - Number of bytes that will be written
+
+Returns: Pointer into data
+
+*/
+
+uint8_t* Skylander::edit(uint8_t block, uint16_t offset, uint16_t len) {
+	uint8_t* destination = plain(block, offset, len);
+	
+	if (!encrypted) {
+		uint8_t last = block + (offset + len - 1) / 0x10;
+		
+		for (uint8_t i = block + offset / 0x10; i <= last; i++) {
+			modifiedMask |= (1ULL << i);
+		}
+	}
+	
+	return destination;
+}
+
+/*
+
+Description: Decrypts every block that hasn't been yet, for things that use data directly.
+
+Arguments:	
+
+Returns:
+
+*/
+
+void Skylander::decryptRemaining() {
+	if (encrypted) return;
+	
+	reseed();
+	
+	uint64_t remaining = 0;
+	for (uint8_t block = 0; block < 0x40; block++) {
+		if (shouldEncryptBlock(block) && !readBit64(decryptedMask, block)) remaining |= (1ULL << block);
+	}
+	
+	cryptBlocks(remaining, false);
+	decryptedMask |= remaining;
+}
+
+/*
+
+Description: Keeps the lazy view consistent when blocks 0x00-0x01 (where every key comes from) have changed since
+			decrypt(), e.g. through setCharacter or the type 0 checksum.  Blocks still holding ciphertext are decrypted
+			under the old keys, and every block is marked modified so encrypt() puts them all under the new keys rather
+			than restoring old ciphertext.
+
+Arguments:	
+
+Returns:
+
+*/
+
+void Skylander::reseed() {
+	if (memcmp(data[0], seed, 0x20) == 0) return;
+	
+	uint64_t remaining = 0;
+	for (uint8_t block = 0; block < 0x40; block++) {
+		if (shouldEncryptBlock(block) && !readBit64(decryptedMask, block)) remaining |= (1ULL << block);
+	}
+	
+	uint8_t current[0x20];
+	memcpy(current, data[0], 0x20);
+	memcpy(data[0], seed, 0x20);
+	cryptBlocks(remaining, false);
+	memcpy(data[0], current, 0x20);
+	
+	memcpy(seed, current, 0x20);
+	decryptedMask = modifiedMask = ~0ULL;
+}
+
+void Skylander::dump() {
+	decryptRemaining();
+	MIFARE_1K::dump();
+}
+
+void Skylander::makeFile(const char* filename) {
+	decryptRemaining();
+	MIFARE_1K::makeFile(filename);
+}
+
+bool Skylander::updateData() {
+	decryptRemaining();
+	return MIFARE_1K::updateData();
+}
+
 bool Skylander::shouldEncryptBlock(uint8_t block) {
 	return ((!isTrailerBlock(block)) && (inRange(block, 0x08, 0x15) || inRange(block, 0x24, 0x31)));
 }
 
-void Skylander::calcAESKey(uint8_t destination[16], uint8_t block) {
+void Skylander::calcAESSeed(uint8_t destination[0x56], uint8_t block) {
 
 	//Key is MD5 hash of a constant, first two blocks, and block number
-	uint8_t md5seed[0x56] = {
+	static const uint8_t md5seed[0x56] = {
 		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
         0x00, 0x20, 0x43, 0x6F, 0x70, 0x79, 0x72, 0x69, 0x67, 0x68, 0x74, 0x20, 0x28, 0x43, 0x29, 0x20, // 0x00 "Copyright (C) "
@@ -256,30 +461,118 @@ void Skylander::calcAESKey(uint8_t destination[16], uint8_t block) {
         0x20, 0x41, 0x6C, 0x6C, 0x20, 0x52, 0x69, 0x67, 0x68, 0x74, 0x73, 0x20, 0x52, 0x65, 0x73, 0x65, // " All Rights Rese"
         0x72, 0x76, 0x65, 0x64, 0x2E, 0x20}; // "rved. "
 
-	memcpy(md5seed, data, 0x20);
-	md5seed[0x20] = block;
+	memcpy(destination, md5seed, 0x56);
+	memcpy(destination, data, 0x20);
+	destination[0x20] = block;
+}
+
+void Skylander::calcAESKey(uint8_t destination[16], uint8_t block) {
+	uint8_t md5seed[0x56];
+	calcAESSeed(md5seed, block);
 	
 	computeMD5(destination, md5seed, 0x56);
-	return;
 }
 
-void Skylander::decryptBlock(uint8_t block) {
-	AES aes(128);
-	uint8_t key[16];
-	calcAESKey(key, block);
+/*
+
+Description: Works out the keys for several blocks at once.  The seeds only differ in the block number, so they go through
+			computeMD5Lanes together with the shared first 0x20 bytes hashed once.
+
+Arguments:	destination - The keys, in the same order as blocks
+			blocks - Which blocks
+			count - How many
+
+Returns:
+
+*/
+
+void Skylander::calcAESKeys(uint8_t destination[][16], uint8_t blocks[], uint8_t count) {
+	uint8_t seeds[0x40][0x56];
+	const uint8_t* messages[0x40];
 	
-	aes.DecryptECB(data[block], 16, key);
+	for (uint8_t i = 0; i < count; i++) {
+		calcAESSeed(seeds[i], blocks[i]);
+		messages[i] = seeds[i];
+	}
+	
+	computeMD5Lanes(destination, messages, 0x56, count, 0x20, 0x21);
 }
 
-void Skylander::encryptBlock(uint8_t block) {
-	AES aes(128);
-	uint8_t key[16];
-	calcAESKey(key, block);
+/*
+
+Description: Encrypts or decrypts a set of blocks in one batch, so hardware AES can keep several blocks in flight.
+
+Arguments:	mask - Which blocks (bit n for block n)
+			encrypting - Direction
+
+Returns:
+
+*/
+
+void Skylander::cryptBlocks(uint64_t mask, bool encrypting) {
+	const AES128Key* keys[0x40];
+	uint8_t* blocks[0x40];
+	uint8_t count = 0;
+	
+	if (!mask) return;
+	prepareKeys();
+	
+	for (uint8_t block = 0; block < 0x40; block++) {
+		if (shouldEncryptBlock(block) && readBit64(mask, block)) {
+			keys[count] = &crypto.key(block);
+			blocks[count++] = data[block];
+		}
+	}
 	
-	aes.EncryptECB(data[block], 16, key, 0);
+	if (encrypting) {
+		AESEncryptBlocks(keys, blocks, blocks, count);
+	} else {
+		AESDecryptBlocks(keys, blocks, blocks, count);
+	}
+}
+
+/*
+
+Description: Makes sure the crypto context has the keys for the current blocks 0x00-0x01, deriving them all at once if not.
+
+Arguments:	
+
+Returns:
+
+*/
+
+void Skylander::prepareKeys() {
+	if (crypto.matches(data[0])) return;
+	
+	uint8_t numbers[0x40];
+	uint8_t md5keys[0x40][0x10];
+	uint8_t count = 0;
+	
+	for (uint8_t block = 0; block < 0x40; block++) {
+		if (shouldEncryptBlock(block)) {
+			numbers[count++] = block;
+		}
+	}
+	
+	calcAESKeys(md5keys, numbers, count);
+	crypto.store(data[0], numbers, md5keys, count);
+}
+
+void Skylander::decryptBlock(uint8_t block) {
+	prepareKeys();
+	crypto.key(block).decrypt(data[block], data[block]);
+}
+
+void Skylander::encryptBlock(uint8_t block) {
+	prepareKeys();
+	crypto.key(block).encrypt(data[block], data[block]);
 }
 
 void Skylander::calcKeyA(uint8_t destination[6], uint8_t sector) {
+	calcKeyA(destination, sector, UID);
+}
+
+void Skylander::calcKeyA(uint8_t destination[6], uint8_t sector, uint8_t uid[4]) {
   if (sector == 0) {
     destination[0] = 0x4b;
     destination[1] = 0x0b;
@@ -290,7 +583,7 @@ void Skylander::calcKeyA(uint8_t destination[6], uint8_t sector) {
     return;
   }
 
-  uint8_t seed[5] = {UID[0], UID[1], UID[2], UID[3], sector};
+  uint8_t seed[5] = {uid[0], uid[1], uid[2], uid[3], sector};
   
   keycrc.compute(seed, 5, destination);
   swapEndian(destination, 6);
@@ -310,69 +603,125 @@ uint8_t Skylander::areaBlock(uint8_t area) {
 	return (area ? 0x24 : 0x08);
 }
 
+/*
+
+Description: Gets the sequence number of a save area, which the game increments each time it saves to that area.
+			Works whether or not the data is currently decrypted.
+
+Arguments:	area - Which save area (0 or 1)
+
+Returns: The sequence number
+
+*/
+
+uint8_t Skylander::areaSequence(uint8_t area) {
+	uint8_t header = areaBlock(area);
+	
+	if (!encrypted) return plain(header, save.offset, save.size)[0];
+	
+	uint8_t decrypted[0x10];
+	
+	prepareKeys();
+	crypto.key(header).decrypt(data[header], decrypted);
+	
+	return decrypted[save.offset];
+}
+
+/*
+
+Description: Orders the writes so a figure removed part way through is left with a valid save.  The payload blocks go
+			first, then the blocks holding checksums, and the header of the newest area (holding its sequence number) last,
+			since that is what makes the game use the new data.
+
+Arguments:	priority - Destination for the priority of each block
+
+Returns: 
+
+*/
+
+void Skylander::writePriorities(uint8_t priority[Geometry::blocks]) {
+	uint8_t commit = (areaSequence(1) > areaSequence(0)) ? 1 : 0;
+	
+	memset(priority, 0x00, 0x40);
+	
+	priority[0x01] = 1;
+	for (uint8_t area = 0; area <= 1; area++) {
+		priority[areaBlock(area)] = 1;
+		priority[areaBlock(area) + 0x09] = 1;
+	}
+	
+	priority[areaBlock(commit)] = 2;
+}
+
+/*
+
+Description: Block 1 (character and type) and the two save area headers (sequence numbers and checksums), which the game
+			changes every time it saves.
+
+Arguments:	blocks - Destination for the block numbers
+
+Returns: Number of blocks
+
+*/
+
+uint8_t Skylander::fingerprintBlocks(uint8_t blocks[Geometry::blocks]) {
+	blocks[0] = 0x01;
+	blocks[1] = areaBlock(0);
+	blocks[2] = areaBlock(1);
+	return 3;
+}
+
 void Skylander::updateChecksums() {
 	for (uint8_t area = 0; area <= 1; area++) { //Do for each data area
+		//Type 1 covers the header, which holds the type 2 and 3 checksums, so it has to go last
 		for (uint8_t type = 0; type <= 4; type++) {//Do each type
-			checksum(type, area);
+			if (type != 1) checksum(type, area);
 		}
+		checksum(1, area);
 	}
 }
 
-bool Skylander::checksum(uint8_t type, uint8_t area) {
+static uint64_t checksumStart(uint8_t type) {
+	uint64_t state = checkcrc.start();
 	
+	if (type == 4) state = checkcrc.update(state, checksumHead4, 2);
+	return state;
+}
+
+static void checksumFinish(uint8_t type, uint64_t state, uint8_t destination[2]) {
+	if (type == 1) state = checkcrc.update(state, checksumTail1, 2);
+	if (type == 3) state = checkcrc.updateZeros(state, checksumZeros3);
+	
+	//Checkcrc is defined at the top of the file
+	checkcrc.finish(state, destination);
+	//All data is stored little endian
+	swapEndian(destination, 2);
+}
+
+bool Skylander::checksum(uint8_t type, uint8_t area) {
+	uint8_t header, block, *destination;
 	
-	uint8_t header, offset, *destination, src[0x200];	
-	uint16_t nBytes;
+	if (type > 4) return false;
 	
 	header = areaBlock(area);
 	
-	//Block and offset are used to find the storage destination variable
-	//Src and nbytes specify what data to feed into the CRC
+	//The covered data goes straight from the blocks into the CRC
 	//Type zero are absolute block/sector values, other types are relative to the two headers
-
-	switch (type) {
-		case 0:
-			nBytes = 0x1E;
-			memcpy(src, data, nBytes);
-			break;
-		case 1:
-			nBytes = 0x10;
-			memcpy(src, data[area], nBytes);
-			src[0x0E] = 0x05;
-			src[0x0F] = 0x00;
-			
-			break;
-		case 2:
-			nBytes = 0x30;
-			memcpy(src, data[area + 1], 0x20);
-			memcpy(src + 0x20, data[area + 4], 0x10);
-			
-			 break;
-		case 3:
-			nBytes = 0x110;
-			memcpy(src, data[area + 5], 0x20);
-			memcpy(src + 0x20, data[area + 8], 0x10);
-			memset(src + 0x30, 0x00, 0xE0);
-			break;
-			
-		case 4:
-			nBytes = 0x40;
-			memcpy(src, data[area + 0x09], 0x20);
-			memcpy(src + 0x20, data[area + 0x0C], 0x20);
-			src[0x00] = 0x06;
-			src[0x01] = 0x01;
-			break;
-			
-		default:
-			return false;
+	uint64_t state = checksumStart(type);
+	
+	for (uint8_t i = 0; i < nChecksumSpans; i++) {
+		const checksumSpan& span = checksumSpans[i];
+		if (span.type != type) continue;
+		
+		uint8_t len = span.to - span.from;
+		state = checkcrc.update(state, plain((type ? header : 0x00) + span.block, span.from, len), len);
 	}
 	
-	destination = (type ? data[header] : data[0x00]) + crc[type].offset;
+	//Block and offset are used to find the storage destination variable
+	block = (type ? header : 0x00) + crc[type].offset / 0x10;
+	destination = edit(block, crc[type].offset % 0x10, crc[type].size);
 	
-	//Checkcrc is defined at the top of the file
-	checkcrc.compute(src, nBytes, destination);
-	//All data is stored little endian
-	swapEndian(destination, 2);
+	checksumFinish(type, state, destination);
 	
 	if (block != 0x01) {
 		flag(block);
@@ -381,32 +730,106 @@ bool Skylander::checksum(uint8_t type, uint8_t area) {
 	return true;
 }
 
+/*
+
+Description: Checks every stored checksum in one pass.  Each area's encrypted blocks are decrypted once, together, into
+			a block buffer (data is left as it is), and each block goes straight into the CRC of the type covering it.
+			Works whether or not the figure is decrypted.
+
+Arguments:	
+
+Returns: Bit (area * 5 + type) set for each checksum that matches; SKYLANDER_CHECKSUMS_VALID if they all do
+
+*/
+
+uint16_t Skylander::validateChecksums() {
+	uint16_t valid = 0;
+	uint8_t computed[2];
+	
+	if (!encrypted) reseed();
+	
+	//Type 0 covers blocks 0x00-0x01, which are never encrypted, and is the same for both areas
+	uint64_t state = checksumStart(0);
+	for (uint8_t i = 0; i < nChecksumSpans && checksumSpans[i].type == 0; i++) {
+		const checksumSpan& span = checksumSpans[i];
+		state = checkcrc.update(state, data[span.block] + span.from, span.to - span.from);
+	}
+	
+	checksumFinish(0, state, computed);
+	if (memcmp(computed, data[crc[0].offset / 0x10] + crc[0].offset % 0x10, 2) == 0) valid |= (1 << 0) | (1 << 5);
+	
+	for (uint8_t area = 0; area <= 1; area++) {
+		uint8_t header = areaBlock(area);
+		uint8_t buffer[0x0E][0x10];
+		const uint8_t* source[0x0E];
+		const AES128Key* keys[0x0E];
+		const uint8_t* in[0x0E];
+		uint8_t* out[0x0E];
+		uint8_t count = 0;
+		
+		for (uint8_t i = 0; i < 0x0E; i++) {
+			uint8_t block = header + i;
+			source[i] = data[block];
+			
+			if (shouldEncryptBlock(block) && (encrypted || !readBit64(decryptedMask, block))) {
+				if (!count) prepareKeys();
+				
+				keys[count] = &crypto.key(block);
+				in[count] = data[block];
+				out[count++] = buffer[i];
+				source[i] = buffer[i];
+			}
+		}
+		
+		AESDecryptBlocks(keys, in, out, count);
+		
+		uint64_t states[5];
+		for (uint8_t type = 1; type <= 4; type++) {
+			states[type] = checksumStart(type);
+		}
+		
+		for (uint8_t i = 0; i < nChecksumSpans; i++) {
+			const checksumSpan& span = checksumSpans[i];
+			if (span.type == 0) continue;
+			
+			states[span.type] = checkcrc.update(states[span.type], source[span.block] + span.from, span.to - span.from);
+		}
+		
+		for (uint8_t type = 1; type <= 4; type++) {
+			checksumFinish(type, states[type], computed);
+			if (memcmp(computed, source[crc[type].offset / 0x10] + crc[type].offset % 0x10, 2) == 0) valid |= (1 << (area * 5 + type));
+		}
+	}
+	
+	return valid;
+}
+
 void Skylander::getArea() {
-	saveBlock = areaBlock(data[0x24][0x09] > data[0x08][0x09] ? 1 : 0);
+	saveBlock = areaBlock(areaSequence(1) > areaSequence(0) ? 1 : 0);
 }
 
 uint32_t Skylander::getXP() {
 
 	uint32_t XP = 0;
 	for (uint8_t i = 0; i < 3; i++) {
-		XP += bytesToInt(data[saveBlock] + xp[i].offset, xp[i].size);
+		XP += bytesToInt(plain(saveBlock, xp[i].offset, xp[i].size), xp[i].size);
 	}
 	return XP;	
 }
 
 bool Skylander::setXP(uint32_t XP) {
 	if (XP <= 33000) {
-		littleEndian(XP, xp[0].size, data[saveBlock] + xp[0].offset);
+		littleEndian(XP, xp[0].size, edit(saveBlock, xp[0].offset, xp[0].size));
 	} else {
-		littleEndian(33000, xp[0].size, data[saveBlock] + xp[0].offset);
+		littleEndian(33000, xp[0].size, edit(saveBlock, xp[0].offset, xp[0].size));
 		XP -= 33000;
 		if (XP <= 63500) {
-			littleEndian(XP, xp[1].size, data[saveBlock] + xp[1].offset);
+			littleEndian(XP, xp[1].size, edit(saveBlock, xp[1].offset, xp[1].size));
 		} else {
-			littleEndian(63500, xp[1].size, data[saveBlock] + xp[1].offset);
+			littleEndian(63500, xp[1].size, edit(saveBlock, xp[1].offset, xp[1].size));
 			XP -= 63500;
 			if (XP > 0xffffff) return false;
-			littleEndian(XP, xp[2].size, data[saveBlock] + xp[2].offset);
+			littleEndian(XP, xp[2].size, edit(saveBlock, xp[2].offset, xp[2].size));
 		}
 	}
 	updateChecksums();
@@ -429,21 +852,21 @@ uint32_t Skylander::levelToXP(uint8_t level) {
 }
 
 uint16_t Skylander::getGold() {
-	uint16_t Gold = bytesToInt(data[saveBlock] + gold.offset, gold.size);
+	uint16_t Gold = bytesToInt(plain(saveBlock, gold.offset, gold.size), gold.size);
 	return Gold;
 }
 
 uint16_t Skylander::getPlaytime() {
-	uint16_t Playtime = bytesToInt(data[saveBlock] + playtime.offset, playtime.size);
+	uint16_t Playtime = bytesToInt(plain(saveBlock, playtime.offset, playtime.size), playtime.size);
 	return Playtime;
 }
 
 void Skylander::getLastPlayed(uint8_t* destination) {
-	memcpy(destination, data[saveBlock] + history[0].offset, history[0].size);
+	memcpy(destination, plain(saveBlock, history[0].offset, history[0].size), history[0].size);
 }
 
 void Skylander::getFirstPlayed(uint8_t* destination) {
-	memcpy(destination, data[saveBlock] + history[1].offset, history[1].size);
+	memcpy(destination, plain(saveBlock, history[1].offset, history[1].size), history[1].size);
 }
 
 uint16_t Skylander::getCharCode() {
@@ -457,25 +880,29 @@ uint16_t Skylander::getTypeCode() {
 }
 
 bool Skylander::getName() {
-	Name.clear();
+	uint8_t length = 0;
 	uint16_t nextChar;
 	
-	for (uint8_t i = 0; i < name[0].size; i += 2) {
-		nextChar = bytesToInt(data[0x08] + name[0].offset + i, 2);
-		if (nextChar > 0x7f) return false;
-		Name += (char)nextChar;
-		if (nextChar == 0) return true;
-	}
+	Name[0] = 0x00;
 	
-	for (uint8_t i = 0; i < name[1].size; i += 2) {
-		nextChar = bytesToInt(data[0x08] + name[1].offset + i, 2);
-		if (nextChar > 0x7f) return false;
-		Name += (char)nextChar;
-		if (nextChar == 0) return true;
+	for (uint8_t half = 0; half < 2; half++) {
+		for (uint8_t i = 0; i < name[half].size; i += 2) {
+			nextChar = bytesToInt(plain(0x08, name[half].offset + i, 2), 2);
+			if (nextChar > 0x7f) return false;
+			Name[length++] = (char)nextChar;
+			Name[length] = 0x00;
+			if (nextChar == 0) return true;
+		}
 	}
 	return true;
 }
 
 void Skylander::getEncryption() {
 	encrypted = !getName();
+	
+	//A decrypted dump has nothing to fall back on, so everything is encrypted again if asked
+	if (!encrypted) {
+		memcpy(seed, data[0], 0x20);
+		decryptedMask = modifiedMask = ~0ULL;
+	}
 }
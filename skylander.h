@@ -5,15 +5,21 @@
 #include <stdint.h>
 #include "misc.h"
 #include "md5.h"
+#include "md5lanes.h"
 #include "AES.h"
+#include "cryptocontext.h"
 #include "CRC.h"
 #include "toynames.h"
 
 
+//validateChecksums sets bit (area * 5 + type) for each checksum that matches
+#define SKYLANDER_CHECKSUMS_VALID 0x03FF
+
 class Skylander : public MIFARE_1K {
 
 	public:
 		Skylander(const char* filename, PN532* nfc);		
+		Skylander(const CardImage& image, PN532* nfc);
 		Skylander(PN532* nfc);
 		Skylander(PN532* nfc, bool isMagic);
 		
@@ -26,11 +32,16 @@ class Skylander : public MIFARE_1K {
 		bool decrypt();
 		bool encrypt();
 		
+		void dump();
+		void makeFile(const char* filename);
+		bool updateData();
+		
 		void calcKeysA();
 		
 		void setCharacter(uint16_t charCode, uint16_t typeCode);
 		
 		void updateChecksums();
+		uint16_t validateChecksums();
 		
 		uint16_t getCharCode();
 		uint16_t getTypeCode();
@@ -57,21 +68,41 @@ class Skylander : public MIFARE_1K {
 		
 	protected:
 		bool encrypted;
+		
+		//While decrypted: blocks in data that hold plaintext, and ones changed since
+		uint64_t decryptedMask;
+		uint64_t modifiedMask;
+		uint8_t cipher[0x40][0x10];
+		uint8_t seed[0x20];		//Blocks 0x00-0x01 when cipher was saved, i.e. what its keys come from
 		uint8_t saveBlock;
-		std::string Name;
+		char Name[0x11];		//Both halves of the name, 8 characters each, plus the terminator
+		CryptoContext crypto;
 		
 		bool shouldEncryptBlock(uint8_t block);
+		void calcAESSeed(uint8_t destination[0x56], uint8_t block);
 		void calcAESKey(uint8_t destination[16], uint8_t block);
+		void calcAESKeys(uint8_t destination[][16], uint8_t blocks[], uint8_t count);
 		void decryptBlock(uint8_t block);
 		void encryptBlock(uint8_t block);
+		void cryptBlocks(uint64_t mask, bool encrypting);
+		uint8_t* plain(uint8_t block, uint16_t offset, uint16_t len);
+		uint8_t* edit(uint8_t block, uint16_t offset, uint16_t len);
+		void decryptRemaining();
+		void reseed();
+		void prepareKeys();
 		
 		void calcKeyA(uint8_t destination[6], uint8_t sector);
+		void calcKeyA(uint8_t destination[6], uint8_t sector, uint8_t uid[4]);
 
 		bool checksum(uint8_t type, uint8_t area);
 		
 		uint8_t areaBlock(uint8_t area);
+		uint8_t areaSequence(uint8_t area);
 		void getArea();
 		
+		void writePriorities(uint8_t priority[Geometry::blocks]);
+		uint8_t fingerprintBlocks(uint8_t blocks[Geometry::blocks]);
+		
 		void getEncryption();
 		
 
@@ -1,7 +1,9 @@
 #include "toynames.h"
+#include <mutex>
 using namespace std;
 
-map <string, uint16_t> toyNames;
+static map <string, uint16_t> toyNames;
+static once_flag namesLoaded;
 
 uint16_t nToys = 0x65;
 const string names[] = {
@@ -46,9 +48,9 @@ const string names[] = {
 						"Knight Mare", "Blackout",
 						};
 						
-uint16_t codes[0x500]; 
+static uint16_t codes[0x500]; 
 
-void loadNames() {
+static void fillNames() {
 
 	fillCodes(codes, 0x0000, 0x21);
 	fillCodes(codes + 0x21, 0x0064, 0x10);
@@ -126,6 +128,20 @@ void loadNames() {
 	
 }
 
+/*
+
+Description: Builds the name table.  It only happens once however many threads ask; after that the table is only read.
+
+Arguments:	
+
+Returns:
+
+*/
+
+void loadNames() {
+	call_once(namesLoaded, fillNames);
+}
+
 void fillCodes(uint16_t* startPtr, uint16_t val, uint16_t n) {
 	
 	for (uint16_t i = 0; i < n; i++) {
@@ -134,12 +150,15 @@ void fillCodes(uint16_t* startPtr, uint16_t val, uint16_t n) {
 }
 
 uint16_t getCode(const char* name) {
+	loadNames();
 	return (toyNames.find(name))->second;
 }
 
-string getCharName(uint16_t code) {
+//Points into the table, which is never changed once loaded, so nothing is copied
+const char* getCharName(uint16_t code) {
+	loadNames();
 	for (map<string, uint16_t>::iterator i = toyNames.begin(); i != toyNames.end(); i++) {
-		if (i->second == code) return (i->first);
+		if (i->second == code) return (i->first.c_str());
 	}
 	
 	return "Unknown";
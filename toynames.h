@@ -7,7 +7,7 @@
 void loadNames();
 void fillCodes(uint16_t* startPtr, uint16_t val, uint16_t n);
 uint16_t getCode(const char* name);
-std::string getCharName(uint16_t code);
+const char* getCharName(uint16_t code);
 
 
 